@@ -0,0 +1,128 @@
+/***************************************
+ * Smallsh: per-line arena allocator
+***************************************/
+#include "smallsh.h"
+
+/*
+// Allocate a new arena block with room for at least size bytes
+*/
+static struct arenaBlock* newArenaBlock(size_t size, struct arenaBlock* next){
+    struct arenaBlock* block = malloc(sizeof(struct arenaBlock) + size);
+
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+/*
+// Allocate memory and initialize an empty arena
+*/
+struct arena* initArena(){
+    struct arena* arena = malloc(sizeof(struct arena));
+
+    arena->head = newArenaBlock(ARENA_BLOCK_SIZE, NULL);
+    return arena;
+}
+
+/*
+// Allocate size bytes from the arena. The memory is aligned for any type and is not zeroed.
+*/
+void* arenaAlloc(struct arena* arena, size_t size){
+    struct arenaBlock* block = arena->head;
+    size_t start = (block->used + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+
+    if(start + size > block->size){
+        // start a new block at least twice the size of the last one
+        size_t blockSize = block->size * 2;
+        if(blockSize < size){
+            blockSize = size;
+        }
+        block = newArenaBlock(blockSize, block);
+        arena->head = block;
+        start = 0;
+    }
+
+    block->used = start + size;
+    return block->data + start;
+}
+
+/*
+// Grow the allocation at ptr from oldSize to newSize bytes and return its new address.
+// The most recent allocation is extended in place when its block has room, otherwise it is copied to a new allocation.
+*/
+void* arenaGrow(struct arena* arena, void* ptr, size_t oldSize, size_t newSize){
+    struct arenaBlock* block = arena->head;
+    void* newPtr;
+
+    if((char*)ptr + oldSize == block->data + block->used && (size_t)((char*)ptr - block->data) + newSize <= block->size){
+        block->used += newSize - oldSize;
+        return ptr;
+    }
+
+    newPtr = arenaAlloc(arena, newSize);
+    memcpy(newPtr, ptr, oldSize);
+    return newPtr;
+}
+
+/*
+// Record the current end of the arena, so that everything allocated after it can be released with arenaRelease()
+*/
+struct arenaMark arenaMark(struct arena* arena){
+    struct arenaMark mark = {arena->head, arena->head->used};
+
+    return mark;
+}
+
+/*
+// Release every allocation made since mark was taken. Marks must be released in the reverse order they were taken,
+// which lets a loop in a script run each of its commands in the same memory.
+*/
+void arenaRelease(struct arena* arena, struct arenaMark mark){
+    struct arenaBlock* block;
+
+    while(arena->head != mark.block){
+        block = arena->head;
+        arena->head = block->next;
+        free(block);
+    }
+    arena->head->used = mark.used;
+}
+
+/*
+// Release every allocation made from the arena.
+// If the last line needed more than one block they are merged into one block big enough for all of them,
+// so a steady stream of similar lines allocates nothing.
+*/
+void resetArena(struct arena* arena){
+    struct arenaBlock* block = arena->head;
+    struct arenaBlock* next;
+    size_t total = 0;
+
+    if(block->next != NULL){
+        while(block != NULL){
+            next = block->next;
+            total += block->size;
+            free(block);
+            block = next;
+        }
+        arena->head = newArenaBlock(total, NULL);
+    }
+    arena->head->used = 0;
+}
+
+/*
+// Free all memory associated with an arena
+*/
+void freeArena(struct arena* arena){
+    struct arenaBlock* block;
+    struct arenaBlock* next;
+
+    if(arena != NULL){
+        for(block = arena->head; block != NULL; block = next){
+            next = block->next;
+            free(block);
+        }
+        free(arena);
+    }
+}
@@ -0,0 +1,433 @@
+/***************************************
+ * Smallsh: throughput and latency benchmarks
+ *
+ * Prints one JSON object per line for each benchmark, so results can be compared by scripts.
+ * usage: bench [-n spawn iterations]
+***************************************/
+#include "smallsh.h"
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define PARSE_ITERATIONS 1000000
+#define EXPAND_ITERATIONS 1000000
+#define SCRIPT_ITERATIONS 1000
+#define GLOB_ITERATIONS 200
+#define GLOB_FILES 10000
+
+/*
+// Lines that look like typical interactive and generated commands
+*/
+static char* parseLines[] = {
+    "ls -la /tmp\n",
+    "cat < input.txt > output.txt\n",
+    "grep -v foo /var/log/syslog | sort | uniq -c | sort -rn | head -20\n",
+    "sleep 5 &\n",
+    "gcc -O2 -Wall -c main.c -o main.o\n",
+    "# a comment line\n",
+};
+
+static char* expandLines[] = {
+    "echo $$ $HOME ${HOME} $? $!",
+    "mkdir -p /tmp/build_$$/obj /tmp/build_$$/bin /tmp/build_$$/lib",
+    "cp $HOME/.profile $HOME/.profile.$$.bak",
+    "echo \"$HOME/$USER\" $PATH ${HOME}_old",
+};
+
+/*
+// Current time in nanoseconds
+*/
+static long long now(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compareLongLong(const void* a, const void* b){
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+// Measure how many lines parseInput() handles per second, including the arena reset after each line
+*/
+static void benchParse(){
+    int numLines = sizeof(parseLines) / sizeof(parseLines[0]);
+    char buffer[256];
+    long long start;
+    double seconds;
+    int i;
+
+    start = now();
+    for(i = 0; i < PARSE_ITERATIONS; i++){
+        // parseInput() splits the line in place, so it gets a fresh copy every time
+        strcpy(buffer, parseLines[i % numLines]);
+        parseInput(commandArena, buffer);
+        resetArena(commandArena);
+    }
+    seconds = (now() - start) / 1e9;
+
+    printf("{\"benchmark\":\"parse\",\"iterations\":%d,\"seconds\":%.6f,\"lines_per_sec\":%.0f}\n",
+           PARSE_ITERATIONS, seconds, PARSE_ITERATIONS / seconds);
+}
+
+/*
+// Measure how many lines full of variables parseInput() tokenizes and expands per second
+*/
+static void benchExpand(){
+    int numLines = sizeof(expandLines) / sizeof(expandLines[0]);
+    char buffer[256];
+    long long start;
+    double seconds;
+    int i;
+
+    start = now();
+    for(i = 0; i < EXPAND_ITERATIONS; i++){
+        char* line = expandLines[i % numLines];
+        strcpy(buffer, line);
+        parseInput(commandArena, buffer);
+        resetArena(commandArena);
+    }
+    seconds = (now() - start) / 1e9;
+
+    printf("{\"benchmark\":\"expand\",\"iterations\":%d,\"seconds\":%.6f,\"expansions_per_sec\":%.0f}\n",
+           EXPAND_ITERATIONS, seconds, EXPAND_ITERATIONS / seconds);
+}
+
+/*
+// Print latency percentiles in microseconds for a set of samples in nanoseconds
+*/
+static void printLatency(char* name, long long* samples, int count){
+    qsort(samples, count, sizeof(long long), compareLongLong);
+    printf("{\"benchmark\":\"%s\",\"iterations\":%d,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}\n",
+           name, count,
+           samples[count / 2] / 1e3,
+           samples[(int)(count * 0.9)] / 1e3,
+           samples[(int)(count * 0.99)] / 1e3,
+           samples[count - 1] / 1e3);
+}
+
+/*
+// Measure the time from launching /bin/true until it has been reaped, as a foreground command run by runCommand()
+// and as a background command in its own process group.
+*/
+static void benchSpawn(int iterations){
+    long long* samples = malloc(iterations * sizeof(long long));
+    char* mode = launchMode == LAUNCH_FORK ? "fork" : "spawn";
+    char name[64];
+    char buffer[32];
+    struct command* trueCommand;
+    pid_t pid;
+    int childStatus;
+    int i;
+
+    for(i = 0; i < iterations; i++){
+        strcpy(buffer, "/bin/true\n");
+        trueCommand = parseInput(commandArena, buffer);
+        samples[i] = now();
+        runCommand(trueCommand, backgroundJobs);
+        samples[i] = now() - samples[i];
+        resetArena(commandArena);
+    }
+    snprintf(name, sizeof(name), "spawn_foreground_%s", mode);
+    printLatency(name, samples, iterations);
+
+    for(i = 0; i < iterations; i++){
+        strcpy(buffer, "/bin/true\n");
+        trueCommand = parseInput(commandArena, buffer);
+        trueCommand->background = 1;
+        samples[i] = now();
+        launchPipeline(trueCommand, &pid, 0, NULL, NULL);
+        waitpid(pid, &childStatus, 0);
+        samples[i] = now() - samples[i];
+        resetArena(commandArena);
+    }
+    snprintf(name, sizeof(name), "spawn_background_%s", mode);
+    printLatency(name, samples, iterations);
+
+    free(samples);
+}
+
+/*
+// A script of control flow and commands, repeated to make a script of a few thousand lines
+*/
+static char* scriptBlock =
+    "backup() {\n"
+    "    for f in $HOME/.profile $HOME/.bashrc; do\n"
+    "        if test -f $f; then cp $f $f.bak; else echo missing $f; fi\n"
+    "    done\n"
+    "}\n"
+    "while test -f /tmp/lock && sleep 1; do echo waiting; done\n"
+    "grep -v foo /var/log/syslog | sort | uniq -c > counts.txt\n"
+    "# a comment line\n";
+
+/*
+// Measure how many lines of a script parseScript() parses per second.
+// This is the work a script cache file saves each time the script runs.
+*/
+static void benchScript(){
+    size_t blockLen = strlen(scriptBlock);
+    int numBlocks = 500;
+    int lines = 0;
+    char* text = malloc(blockLen * numBlocks + 1);
+    struct script* script = initScript();
+    long long start;
+    double seconds;
+    char* c;
+    int i;
+
+    for(i = 0; i < numBlocks; i++){
+        memcpy(text + i * blockLen, scriptBlock, blockLen);
+    }
+    text[blockLen * numBlocks] = '\0';
+    for(c = text; *c != '\0'; c++){
+        lines += *c == '\n';
+    }
+
+    start = now();
+    for(i = 0; i < SCRIPT_ITERATIONS; i++){
+        // the batch input splits lines in place, so it gets a fresh copy every time
+        batch = openCommandString(text);
+        resetScript(script);
+        parseScript(script, 0);
+        closeBatchInput(batch);
+    }
+    batch = NULL;
+    seconds = (now() - start) / 1e9;
+
+    printf("{\"benchmark\":\"script_parse\",\"iterations\":%d,\"seconds\":%.6f,\"lines_per_sec\":%.0f}\n",
+           SCRIPT_ITERATIONS, seconds, (double)SCRIPT_ITERATIONS * lines / seconds);
+    releaseScript(script);
+    free(text);
+}
+
+/*
+// Measure the latency of "test 1 -lt 2", which runs as a builtin inside smallsh, for comparison with the spawn benchmarks
+*/
+static void benchBuiltin(int iterations){
+    long long* samples = malloc(iterations * sizeof(long long));
+    char buffer[32];
+    struct command* testCommand;
+    int i;
+
+    for(i = 0; i < iterations; i++){
+        strcpy(buffer, "test 1 -lt 2\n");
+        testCommand = parseInput(commandArena, buffer);
+        samples[i] = now();
+        runCommand(testCommand, backgroundJobs);
+        samples[i] = now() - samples[i];
+        resetArena(commandArena);
+    }
+    printLatency("builtin_test", samples, iterations);
+    free(samples);
+}
+
+/*
+// Measure the latency of a command substitution while parsing a line, for one that runs a utility builtin inside
+// smallsh and for one that needs a forked copy of smallsh
+*/
+static void benchSubstitution(int iterations){
+    long long* samples = malloc(iterations * sizeof(long long));
+    char* lines[] = {"echo $(printf hi)\n", "echo $(printf hi; true)\n"};
+    char* names[] = {"substitution_builtin", "substitution_fork"};
+    char buffer[64];
+    int i;
+    int j;
+
+    for(j = 0; j < 2; j++){
+        for(i = 0; i < iterations; i++){
+            strcpy(buffer, lines[j]);
+            samples[i] = now();
+            parseInput(commandArena, buffer);
+            samples[i] = now() - samples[i];
+            resetArena(commandArena);
+        }
+        printLatency(names[j], samples, iterations);
+    }
+    free(samples);
+}
+
+/*
+// Measure opening a history of a million entries, the first recall of its oldest entry by prefix, which maps the
+// file and builds the indexes, and later recalls by prefix and by substring
+*/
+static void benchHistory(int iterations){
+    long long* samples = malloc(iterations * sizeof(long long));
+    char path[64];
+    char line[64];
+    FILE* file;
+    long long openTime;
+    long long indexTime;
+    int i;
+
+    snprintf(path, sizeof(path), "/tmp/smallsh-bench-%d.history", getpid());
+    file = fopen(path, "w");
+    fprintf(file, "oldest entry\n");
+    for(i = 0; i < 1000000; i++){
+        fprintf(file, "echo %d command line %d\n", i % 1000, i);
+    }
+    fclose(file);
+    setVariable(shellVariables, "HISTFILE", path, 0);
+
+    openTime = now();
+    openHistory();
+    openTime = now() - openTime;
+    indexTime = now();
+    strcpy(line, "!old");
+    expandHistory(line);
+    indexTime = now() - indexTime;
+    printf("{\"benchmark\":\"history_load\",\"entries\":%d,\"open_us\":%.1f,\"first_prefix_recall_us\":%.1f}\n",
+           1000001, openTime / 1000.0, indexTime / 1000.0);
+
+    for(i = 0; i < iterations; i++){
+        strcpy(line, "!old");
+        samples[i] = now();
+        expandHistory(line);
+        samples[i] = now() - samples[i];
+    }
+    printLatency("history_prefix", samples, iterations);
+    for(i = 0; i < iterations; i++){
+        strcpy(line, "!?line 500000");
+        samples[i] = now();
+        expandHistory(line);
+        samples[i] = now() - samples[i];
+    }
+    printLatency("history_substring", samples, iterations);
+
+    closeHistory();
+    unsetVariable(shellVariables, "HISTFILE");
+    unlink(path);
+    free(samples);
+}
+
+/*
+// Measure how many file names parseInput() expands per second, for a line with three patterns over one directory
+// of 10000 files, which is read once per line
+*/
+static void benchGlob(){
+    char dir[64];
+    char path[96];
+    char line[256];
+    struct command* smallsh_command;
+    long long start;
+    double seconds;
+    long matches = 0;
+    int i;
+
+    snprintf(dir, sizeof(dir), "/tmp/smallsh-bench-%d.glob", getpid());
+    mkdir(dir, 0700);
+    for(i = 0; i < GLOB_FILES; i++){
+        snprintf(path, sizeof(path), "%s/file%d.%s", dir, i, i % 2 == 0 ? "log" : "txt");
+        close(open(path, O_WRONLY | O_CREAT, 0600));
+    }
+
+    start = now();
+    for(i = 0; i < GLOB_ITERATIONS; i++){
+        snprintf(line, sizeof(line), "ls %s/*.log %s/file1?.txt %s/file[0-4]*[05].txt", dir, dir, dir);
+        smallsh_command = parseInput(commandArena, line);
+        matches += smallsh_command->argc - 1;
+        resetArena(commandArena);
+    }
+    seconds = (now() - start) / 1e9;
+
+    printf("{\"benchmark\":\"glob\",\"entries\":%d,\"iterations\":%d,\"seconds\":%.6f,\"lines_per_sec\":%.0f,"
+           "\"matches_per_sec\":%.0f}\n", GLOB_FILES, GLOB_ITERATIONS, seconds, GLOB_ITERATIONS / seconds, matches / seconds);
+
+    for(i = 0; i < GLOB_FILES; i++){
+        snprintf(path, sizeof(path), "%s/file%d.%s", dir, i, i % 2 == 0 ? "log" : "txt");
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+/*
+// Measure the round trip of a "true" request to a server started with --serve, which forks a worker for each
+// request instead of starting a new shell, for comparison with the spawn benchmarks
+*/
+static void benchServe(int iterations){
+    long long* samples = malloc(iterations * sizeof(long long));
+    char path[64];
+    struct sockaddr_un address = {0};
+    pid_t server;
+    int probe;
+    int fd;
+    int i;
+
+    snprintf(path, sizeof(path), "/tmp/smallsh-bench-%d.sock", getpid());
+    fflush(stdout);
+    server = fork();
+    if(server == 0){
+        smallsh_signals();
+        exit(serve(path, 4));
+    }
+    // the socket file appears at bind(), before the server listens, so wait until a connection is accepted
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    for(i = 0; i < 1000; i++){
+        probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(probe != -1 && connect(probe, (struct sockaddr*)&address, sizeof(address)) == 0){
+            close(probe);
+            break;
+        }
+        if(probe != -1){
+            close(probe);
+        }
+        usleep(1000);
+    }
+    fd = connectServer(path);
+    if(fd != -1){
+        for(i = 0; i < iterations; i++){
+            samples[i] = now();
+            runRequest(fd, "true", 4);
+            samples[i] = now() - samples[i];
+        }
+        close(fd);
+        printLatency("serve_request", samples, iterations);
+    }
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(path);
+    free(samples);
+}
+
+int main(int argc, char* argv[]){
+    int spawnIterations = 2000;
+
+    if(argc == 3 && strcmp(argv[1], "-n") == 0){
+        spawnIterations = atoi(argv[2]);
+    }
+    if(spawnIterations < 1){
+        fprintf(stderr, "usage: %s [-n spawn iterations]\n", argv[0]);
+        return 2;
+    }
+
+    commandArena = initArena();
+    shellVariables = initVariables(environ);
+    commandPaths = initPathCache();
+    backgroundJobs = initJobTable();
+    scriptFunctions = initFunctionTable();
+
+    benchParse();
+    benchExpand();
+    benchGlob();
+    benchScript();
+    benchBuiltin(spawnIterations);
+    benchSubstitution(spawnIterations);
+    benchHistory(spawnIterations);
+
+    launchMode = LAUNCH_SPAWN;
+    benchSpawn(spawnIterations);
+    launchMode = LAUNCH_FORK;
+    benchSpawn(spawnIterations);
+    benchServe(spawnIterations);
+
+    freeJobTable(backgroundJobs);
+    freeFunctionTable(scriptFunctions);
+    freePathCache(commandPaths);
+    freeVariables(shellVariables);
+    freeArena(commandArena);
+    return EXIT_SUCCESS;
+}
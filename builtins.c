@@ -0,0 +1,335 @@
+/***************************************
+ * Smallsh: builtin commands
+***************************************/
+#include "smallsh.h"
+
+/*
+// Exit smallsh
+// frees dynamic memory
+// calls exit() to end smallsh with the given status
+*/
+void smallsh_exit(int status){
+    closeBatchInput(batch);
+    releaseScript(commandScript);
+    freeFunctionTable(scriptFunctions);
+    freeStats(commandStats);
+    freePathCache(commandPaths);
+    freeArena(commandArena);
+    freeJobTable(backgroundJobs);
+    closeHistory();
+    freeVariables(shellVariables);
+    exit(status);
+}
+
+/*
+// The exit builtin, exits with the given status or the status of the last foreground command
+*/
+static void smallsh_exitCommand(struct command* smallsh_command){
+    smallsh_exit(smallsh_command->args[1] != NULL ? atoi(smallsh_command->args[1]) : exitStatus);
+}
+
+/*
+// Change the working directory of smallsh
+// takes a path to the new directory as a char* argument
+// If no arg is given, it changes working directory to the HOME directory
+*/
+void smallsh_cd(struct command* smallsh_command){
+    char* dir = smallsh_command->args[1] != NULL ? smallsh_command->args[1] : getVariable(shellVariables, "HOME");
+
+    exitStatus = 0;
+    if(dir != NULL && chdir(dir) == -1){
+        perror(dir);
+        exitStatus = 1;
+    }
+}
+
+/*
+// Print the exit status of the last foreground process that completed.
+// If no processes have been run since smallsh was started, exitStatus will be 0.
+// The policy that background jobs are launched with follows, if bgpolicy set one.
+*/
+void smallsh_status(struct command* smallsh_command){
+    char* policy = describePolicy(&backgroundPolicy);
+
+    printf("exit value %d\n", exitStatus > 1 ? 1 : exitStatus);
+    if(policy != NULL){
+        printf("background policy: %s\n", policy);
+        free(policy);
+    }
+    fflush(stdout);
+}
+
+/*
+// Parse a job specification, either %n for job number n or a pid.
+// Returns the job's slot in the table, or -1 and prints an error if there is no such job.
+*/
+int parseJobSpec(struct jobTable* table, char* spec){
+    int slot;
+
+    if(spec[0] == '%'){
+        slot = findJobByNumber(table, atoi(spec + 1));
+    } else {
+        slot = findJobByPid(table, atoi(spec));
+    }
+    if(slot == -1){
+        fprintf(stderr, "%s: no such job\n", spec);
+        fflush(stderr);
+    }
+    return slot;
+}
+
+/*
+// List the background jobs that are still running
+*/
+void smallsh_jobs(struct command* smallsh_command){
+    struct jobTable* table = backgroundJobs;
+    int i;
+
+    for(i = 0; i < table->used; i++){
+        if(table->slots[i].pid != 0){
+            printf("[%d] %d %s", i + 1, table->slots[i].pid, table->slots[i].commandLine);
+            if(table->slots[i].policy != NULL){
+                printf(" (%s)", table->slots[i].policy);
+            }
+            printf("\n");
+        }
+    }
+    fflush(stdout);
+}
+
+/*
+// Wait for a background job to finish.
+// With a job specification (%n or a pid) it waits for that job, otherwise it waits for every job.
+// Sets exitStatus to the status of the last job that finished.
+*/
+void smallsh_wait(struct command* smallsh_command){
+    char** args = smallsh_command->args;
+    struct jobTable* table = backgroundJobs;
+    int i;
+    int slot;
+
+    if(args[1] != NULL){
+        slot = parseJobSpec(table, args[1]);
+        if(slot == -1){
+            exitStatus = 1;
+            return;
+        }
+        exitStatus = exitCode(waitJob(table, slot));
+        return;
+    }
+
+    for(i = 0; i < table->used; i++){
+        if(table->slots[i].pid != 0){
+            exitStatus = exitCode(waitJob(table, i));
+        }
+    }
+}
+
+/*
+// Parse the signal of kill, a number or a name with or without SIG, such as 9, KILL or SIGKILL.
+// Returns -1 if it is not a signal.
+*/
+static int parseSignal(char* name){
+    const char* abbrev;
+    char* end;
+    long signum;
+    int i;
+
+    if(isdigit((unsigned char)name[0])){
+        signum = strtol(name, &end, 10);
+        return *end == '\0' && signum < NSIG ? (int)signum : -1;
+    }
+    if(strncasecmp(name, "SIG", 3) == 0){
+        name += 3;
+    }
+    for(i = 1; i < NSIG; i++){
+        abbrev = sigabbrev_np(i);
+        if(abbrev != NULL && strcasecmp(abbrev, name) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+// Send a signal to background jobs or processes.
+// Usage: kill [-signal] %n|pid ... The default signal is SIGTERM. A pid that belongs to a job signals every
+// process of the job, any other pid is signalled on its own.
+*/
+void smallsh_kill(struct command* smallsh_command){
+    struct jobTable* table = backgroundJobs;
+    int signum = SIGTERM;
+    int slot;
+    pid_t pid;
+    char** spec = smallsh_command->args + 1;
+
+    if(spec[0] != NULL && spec[0][0] == '-'){
+        signum = parseSignal(spec[0] + 1);
+        spec++;
+    }
+    if(spec[0] == NULL || signum == -1){
+        if(signum == -1){
+            fprintf(stderr, "kill: %s: invalid signal\n", spec[-1] + 1);
+        }
+        fprintf(stderr, "usage: kill [-signal] %%n|pid ...\n");
+        fflush(stderr);
+        exitStatus = 1;
+        return;
+    }
+
+    exitStatus = 0;
+    for(; spec[0] != NULL; spec++){
+        if(spec[0][0] == '%'){
+            slot = parseJobSpec(table, spec[0]);
+            if(slot == -1){
+                exitStatus = 1;
+                continue;
+            }
+            pid = -table->slots[slot].pid;
+        } else if(spec[0][0] != '\0' && spec[0][strspn(spec[0], "0123456789")] == '\0'){
+            pid = atoi(spec[0]);
+            slot = findJobByPid(table, pid);
+            if(slot != -1){
+                pid = -table->slots[slot].pid;
+            }
+        } else {
+            fprintf(stderr, "kill: %s: arguments must be process or job IDs\n", spec[0]);
+            fflush(stderr);
+            exitStatus = 1;
+            continue;
+        }
+        if(kill(pid, signum) == -1){
+            fprintf(stderr, "kill: %s: %s\n", spec[0], strerror(errno));
+            fflush(stderr);
+            exitStatus = 1;
+        }
+    }
+}
+
+/*
+// Show or change the command path cache.
+//  hash            list the cached commands with the number of times each was used
+//  hash -r         forget every cached path
+//  hash name ...   look up each name in PATH and cache it
+*/
+void smallsh_hash(struct command* smallsh_command){
+    char** args = smallsh_command->args;
+    struct pathCache* cache = commandPaths;
+    int i;
+
+    exitStatus = 0;
+    if(args[1] == NULL){
+        if(cache->count == 0){
+            printf("hash: hash table empty\n");
+        } else {
+            printf("hits\tcommand\n");
+            for(i = 0; i < cache->capacity; i++){
+                if(cache->entries[i].name != NULL){
+                    printf("%4d\t%s\n", cache->entries[i].hits, cache->entries[i].path);
+                }
+            }
+        }
+        fflush(stdout);
+        return;
+    }
+
+    if(strcmp(args[1], "-r") == 0){
+        clearPathCache(cache);
+        return;
+    }
+
+    for(i = 1; args[i] != NULL; i++){
+        forgetCommand(cache, args[i]);
+        if(lookupCommand(cache, args[i]) == NULL){
+            fprintf(stderr, "hash: %s: not found\n", args[i]);
+            fflush(stderr);
+            exitStatus = 1;
+        }
+    }
+}
+
+/*
+// Show or reset the resource usage of the commands that have been run.
+//  stats      print the totals and histograms of spawn latency and runtime for each command name
+//  stats -r   forget the stats collected so far
+*/
+void smallsh_stats(struct command* smallsh_command){
+    exitStatus = 0;
+    if(smallsh_command->args[1] != NULL && strcmp(smallsh_command->args[1], "-r") == 0){
+        resetStats(commandStats);
+        return;
+    }
+    printStats(commandStats);
+}
+
+/*
+// Every builtin, sorted by name so a command name can be found with a binary search.
+// Names must match exactly, so cdx is not taken for cd.
+*/
+static struct builtin builtinTable[] = {
+    {":", smallsh_true, 0},
+    {"[", smallsh_test, BUILTIN_UTILITY},
+    {"bgpolicy", smallsh_bgpolicy, 0},
+    {"break", smallsh_break, 0},
+    {"cd", smallsh_cd, 0},
+    {"continue", smallsh_continue, 0},
+    {"echo", smallsh_echo, BUILTIN_UTILITY},
+    {"exit", smallsh_exitCommand, 0},
+    {"export", smallsh_export, 0},
+    {"false", smallsh_false, BUILTIN_UTILITY},
+    {"hash", smallsh_hash, 0},
+    {"history", smallsh_history, 0},
+    {"jobs", smallsh_jobs, 0},
+    {"kill", smallsh_kill, 0},
+    {"parallel", smallsh_parallel, BUILTIN_OWN_INPUT},
+    {"printf", smallsh_printf, BUILTIN_UTILITY},
+    {"pwd", smallsh_pwd, BUILTIN_UTILITY},
+    {"read", smallsh_read, 0},
+    {"return", smallsh_return, 0},
+    {"stats", smallsh_stats, 0},
+    {"status", smallsh_status, 0},
+    {"test", smallsh_test, BUILTIN_UTILITY},
+    {"true", smallsh_true, BUILTIN_UTILITY},
+    {"unset", smallsh_unset, 0},
+    {"wait", smallsh_wait, 0},
+};
+
+static int compareBuiltin(const void* name, const void* entry){
+    return strcmp(name, ((const struct builtin*)entry)->name);
+}
+
+/*
+// Find the builtin with the given name, or return NULL if name is not a builtin
+*/
+struct builtin* findBuiltin(char* name){
+    return bsearch(name, builtinTable, sizeof(builtinTable) / sizeof(builtinTable[0]), sizeof(struct builtin), compareBuiltin);
+}
+
+/*
+// Run a builtin inside smallsh.
+// Its redirections are applied to the fds of smallsh itself and undone once the builtin returns,
+// so no process is started for it.
+// Output the builtin could not write, to a closed fd or a full device, is reported and makes its status 1.
+*/
+void runBuiltin(struct builtin* builtin, struct command* smallsh_command){
+    int* saved;
+    int err;
+
+    if(redirectShell(smallsh_command, builtin->flags & BUILTIN_OWN_INPUT, &saved) == -1){
+        exitStatus = 1;
+        return;
+    }
+    clearerr(stdout);
+    builtin->run(smallsh_command);
+
+    // errno is only that of the write if the final fflush() fails. A write that failed earlier in the builtin
+    // is only remembered by the stream's error flag, and is reported as EIO.
+    err = fflush(stdout) == EOF ? errno : ferror(stdout) ? EIO : 0;
+    if(err != 0){
+        fprintf(stderr, "%s: write error: %s\n", smallsh_command->args[0], strerror(err));
+        fflush(stderr);
+        clearerr(stdout);
+        exitStatus = 1;
+    }
+    restoreShell(smallsh_command, saved);
+}
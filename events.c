@@ -0,0 +1,180 @@
+/***************************************
+ * Smallsh: signal and event handling
+ * SIGCHLD, SIGINT and SIGTSTP stay blocked in smallsh and are read from a signalfd, so no work is done in signal
+ * handlers. While waiting at the prompt smallsh sleeps in epoll on stdin and the signalfd, so background jobs are
+ * reaped and reported as soon as they finish.
+***************************************/
+#include "smallsh.h"
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+
+static int signalFd = -1;           // signalfd for SIGCHLD, SIGINT and SIGTSTP, -1 before initEvents()
+static int epollFd = -1;            // epoll set of stdin and signalFd
+static int stdinPollable = 0;       // 0 if stdin is a regular file, which epoll cannot watch but is always readable
+static int pendingStops = 0;        // SIGTSTPs read while a foreground command was running, handled after it finishes
+
+/*
+// Block the signals smallsh handles and set up the signalfd and epoll set used to wait for them.
+// Blocked signals are kept pending until they are read from the signalfd. Children start with an empty signal mask.
+// SIGINT and SIGTSTP are also ignored, once, so children inherit SIG_IGN for them without smallsh changing their
+// disposition around each launch, which would discard any pending instance. A blocked signal is never discarded
+// for being ignored, so the signalfd still reads them.
+*/
+void initEvents(){
+    struct epoll_event event = {0};
+    struct sigaction ignoreAction = {0};
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    ignoreAction.sa_handler = SIG_IGN;
+    sigaction(SIGINT, &ignoreAction, NULL);
+    sigaction(SIGTSTP, &ignoreAction, NULL);
+
+    signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(signalFd == -1){
+        perror("signalfd()");
+        exit(1);
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(epollFd == -1){
+        perror("epoll_create1()");
+        exit(1);
+    }
+    event.events = EPOLLIN;
+    event.data.fd = signalFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &event);
+    event.data.fd = STDIN_FILENO;
+    stdinPollable = epoll_ctl(epollFd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == 0;
+}
+
+/*
+// The signalfd that SIGCHLD, SIGINT and SIGTSTP are read from, for event loops outside this file
+*/
+int signalEvents(){
+    return signalFd;
+}
+
+/*
+// Switch foreground-only mode on or off, as SIGTSTP does
+*/
+void toggleForegroundOnly(){
+    if(runBackground == 1){
+        printf("Entering foreground-only mode (& is now ignored)\n");
+        runBackground = 0;
+    } else {
+        printf("Exiting foreground-only mode\n");
+        runBackground = 1;
+    }
+    fflush(stdout);
+}
+
+/*
+// Read every pending signal from the signalfd. SIGTSTPs are counted in pendingStops.
+// Sets *childExited if a SIGCHLD was read and *interrupted if a SIGINT was read.
+*/
+static void readSignals(int* childExited, int* interrupted){
+    struct signalfd_siginfo info;
+
+    while(read(signalFd, &info, sizeof(info)) == sizeof(info)){
+        if(info.ssi_signo == SIGCHLD){
+            *childExited = 1;
+        } else if(info.ssi_signo == SIGTSTP){
+            pendingStops++;
+        } else if(info.ssi_signo == SIGINT){
+            *interrupted = 1;
+        }
+    }
+}
+
+/*
+// Handle the signals that arrived since the last call: reap finished background jobs and toggle
+// foreground-only mode for every SIGTSTP. At the prompt a SIGINT starts a new line.
+// Returns 1 if anything was printed, so the prompt has to be printed again.
+*/
+int handleSignals(int atPrompt){
+    int childExited = 0;
+    int interrupted = 0;
+    int printed = 0;
+
+    if(signalFd == -1){
+        return 0;
+    }
+    readSignals(&childExited, &interrupted);
+    if(childExited && reapJobs(backgroundJobs) > 0){
+        printed = 1;
+    }
+    for(; pendingStops > 0; pendingStops--){
+        toggleForegroundOnly();
+        printed = 1;
+    }
+    if(interrupted && atPrompt){
+        printf("\n");
+        fflush(stdout);
+        printed = 1;
+    }
+    return printed;
+}
+
+/*
+// Sleep until a child process may have changed state.
+// SIGTSTPs that arrive meanwhile are kept for handleSignals(), SIGINTs are meant for the foreground command and
+// only set foregroundInterrupted.
+*/
+void waitForChild(){
+    struct pollfd pollFd = {signalFd, POLLIN, 0};
+    siginfo_t info;
+    int childExited = 0;
+    int interrupted = 0;
+
+    if(signalFd == -1){
+        // without a signalfd, wait for a child to exit without reaping it
+        waitid(P_ALL, 0, &info, WEXITED | WNOWAIT);
+        return;
+    }
+    while(!childExited){
+        if(poll(&pollFd, 1, -1) == -1 && errno != EINTR){
+            return;
+        }
+        readSignals(&childExited, &interrupted);
+    }
+    if(interrupted){
+        foregroundInterrupted = 1;
+    }
+}
+
+/*
+// Sleep until stdin is readable. Signals that arrive meanwhile are handled right away,
+// and prompt is printed again after anything they print.
+*/
+void waitForInput(char* prompt){
+    struct epoll_event events[2];
+    int numEvents;
+    int i;
+
+    if(signalFd == -1 || !stdinPollable){
+        return;
+    }
+    while(1){
+        numEvents = epoll_wait(epollFd, events, 2, -1);
+        if(numEvents == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            return;
+        }
+        for(i = 0; i < numEvents; i++){
+            if(events[i].data.fd == STDIN_FILENO){
+                return;
+            }
+        }
+        if(handleSignals(1)){
+            printf("%s", prompt);
+            fflush(stdout);
+        }
+    }
+}
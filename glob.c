@@ -0,0 +1,487 @@
+/***************************************
+ * Smallsh: filename expansion
+ * A word with an unquoted *, ? or [...] is a pattern, replaced by the sorted paths that match it. Each path segment
+ * of the pattern is compiled once, then matched against directory entries read with getdents64() straight into the
+ * arena. Listings are cached for the rest of the line, so several patterns over the same directory read it once,
+ * and a match in the working directory is the entry's own name in the listing, without a copy.
+ * A ** segment matches any number of directories, including none.
+***************************************/
+#include "smallsh.h"
+#include <dirent.h>
+
+#define GLOB_READ_SIZE 65536        // least room given to each getdents64() call, listings grow by doubling
+#define GLOB_LITERAL 0              // kinds of part of a compiled segment
+#define GLOB_ANY 1                  // ?
+#define GLOB_STAR 2                 // *
+#define GLOB_CLASS 3                // [...]
+#define SEGMENT_LITERAL 0           // kinds of segment: no pattern characters, used as it is
+#define SEGMENT_PATTERN 1
+#define SEGMENT_GLOBSTAR 2          // **
+
+/*
+// One part of a compiled segment
+*/
+struct globPart{
+    int type;
+    char* text;                 // text of GLOB_LITERAL
+    size_t len;
+    unsigned char set[32];      // bytes matched by GLOB_CLASS, one bit each
+};
+
+/*
+// A path segment of a pattern, the text between two '/'
+*/
+struct globSegment{
+    int type;                   // one of the SEGMENT_ constants
+    struct globPart* parts;
+    int numParts;
+    char* text;                 // the segment without its escapes, used as it is by SEGMENT_LITERAL
+    int hidden;                 // 1 if the segment starts with '.', so it can match hidden entries
+    char* suffix;               // literal text the segment ends with, checked before anything else
+    size_t suffixLen;
+};
+
+/*
+// State of one expansion
+*/
+struct globState{
+    struct globCache* cache;
+    struct globSegment* segments;
+    int numSegments;
+    int dirOnly;                // 1 if the pattern ends with '/', so only directories match
+    char** matches;
+    int numMatches;
+    int capacity;
+};
+
+/*
+// Allocate an empty cache of directory listings from arena. It is valid until the arena is reset.
+*/
+struct globCache* initGlobCache(struct arena* arena){
+    struct globCache* cache = arenaAlloc(arena, sizeof(struct globCache));
+
+    cache->arena = arena;
+    cache->count = 0;
+    cache->capacity = 16;
+    cache->dirs = arenaAlloc(arena, cache->capacity * sizeof(struct globDir));
+    memset(cache->dirs, 0, cache->capacity * sizeof(struct globDir));
+    return cache;
+}
+
+/*
+// Find the slot of the listing of path, or the empty slot where it would be stored
+*/
+static struct globDir* findDir(struct globCache* cache, const char* path){
+    int bucket = (int)(hashString(path) & (unsigned int)(cache->capacity - 1));
+
+    while(cache->dirs[bucket].path != NULL && strcmp(cache->dirs[bucket].path, path) != 0){
+        bucket = (bucket + 1) & (cache->capacity - 1);
+    }
+    return &cache->dirs[bucket];
+}
+
+/*
+// Return the listing of the directory at path, "" for the working directory, reading it the first time.
+// A directory that cannot be read has no entries.
+*/
+static struct globDir* listDirectory(struct globCache* cache, char* path){
+    struct globDir* dir = findDir(cache, path);
+    struct globDir* oldDirs;
+    size_t capacity = GLOB_READ_SIZE;
+    ssize_t numRead;
+    int oldCapacity;
+    int fd;
+    int i;
+
+    if(dir->path != NULL){
+        return dir;
+    }
+
+    // keep the table at most half full
+    if((cache->count + 1) * 2 > cache->capacity){
+        oldDirs = cache->dirs;
+        oldCapacity = cache->capacity;
+        cache->capacity *= 2;
+        cache->dirs = arenaAlloc(cache->arena, cache->capacity * sizeof(struct globDir));
+        memset(cache->dirs, 0, cache->capacity * sizeof(struct globDir));
+        for(i = 0; i < oldCapacity; i++){
+            if(oldDirs[i].path != NULL){
+                *findDir(cache, oldDirs[i].path) = oldDirs[i];
+            }
+        }
+        dir = findDir(cache, path);
+    }
+    cache->count++;
+    dir->path = path;
+    dir->entries = NULL;
+    dir->len = 0;
+
+    fd = open(path[0] != '\0' ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd == -1){
+        return dir;
+    }
+
+    // the records are read straight into the listing, which doubles whenever less than one read's worth is left
+    dir->entries = arenaAlloc(cache->arena, capacity);
+    while(1){
+        if(capacity - dir->len < GLOB_READ_SIZE){
+            dir->entries = arenaGrow(cache->arena, dir->entries, capacity, capacity * 2);
+            capacity *= 2;
+        }
+        numRead = getdents64(fd, dir->entries + dir->len, capacity - dir->len);
+        if(numRead <= 0){
+            break;
+        }
+        dir->len += numRead;
+    }
+    close(fd);
+    return dir;
+}
+
+/*
+// Return path and name joined with a '/', followed by suffix. A name in the working directory without a suffix
+// is returned as it is.
+*/
+static char* joinPath(struct arena* arena, char* path, char* name, char* suffix){
+    size_t pathLen = strlen(path);
+    size_t nameLen = strlen(name);
+    size_t suffixLen = strlen(suffix);
+    int slash = pathLen > 0 && path[pathLen - 1] != '/';
+    char* joined;
+
+    if(pathLen == 0 && suffixLen == 0){
+        return name;
+    }
+    joined = arenaAlloc(arena, pathLen + slash + nameLen + suffixLen + 1);
+    memcpy(joined, path, pathLen);
+    joined[pathLen] = '/';
+    memcpy(joined + pathLen + slash, name, nameLen);
+    memcpy(joined + pathLen + slash + nameLen, suffix, suffixLen + 1);
+    return joined;
+}
+
+/*
+// Return 1 if the entry of dir is a directory. d_type is used when the file system provides it, the file is only
+// looked at when it does not, or when it is a symbolic link and follow is set.
+*/
+static int isDirectory(struct arena* arena, struct globDir* dir, struct dirent64* entry, int follow){
+    struct stat info;
+
+    if(entry->d_type == DT_DIR){
+        return 1;
+    }
+    if(entry->d_type != DT_UNKNOWN && !(follow && entry->d_type == DT_LNK)){
+        return 0;
+    }
+    return fstatat(AT_FDCWD, joinPath(arena, dir->path[0] != '\0' ? dir->path : ".", entry->d_name, ""), &info,
+                   follow ? 0 : AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(info.st_mode);
+}
+
+/*
+// Compile the segment of a pattern from text up to end, where a backslash escapes the character after it
+*/
+static void compileSegment(struct arena* arena, struct globSegment* segment, char* text, char* end){
+    struct globPart* part;
+    char* literal = arenaAlloc(arena, end - text + 1);
+    size_t literalLen = 0;
+    int negate;
+    int low;
+    int c;
+    char* close;
+
+    segment->parts = arenaAlloc(arena, (end - text + 1) * sizeof(struct globPart));
+    segment->numParts = 0;
+    segment->type = SEGMENT_LITERAL;
+    segment->text = literal;
+    segment->hidden = *text == '.' || (*text == '\\' && text[1] == '.');
+    segment->suffix = NULL;
+    segment->suffixLen = 0;
+    literal[0] = '\0';
+    if(end - text == 2 && text[0] == '*' && text[1] == '*'){
+        segment->type = SEGMENT_GLOBSTAR;
+        return;
+    }
+
+    while(text < end){
+        part = &segment->parts[segment->numParts];
+        if(*text == '*' || *text == '?'){
+            segment->type = SEGMENT_PATTERN;
+            if(*text == '?' || segment->numParts == 0 || part[-1].type != GLOB_STAR){
+                part->type = *text == '*' ? GLOB_STAR : GLOB_ANY;
+                segment->numParts++;
+            }
+            text++;
+            continue;
+        }
+
+        // a bracket expression without its ']' is an ordinary '['
+        close = NULL;
+        if(*text == '['){
+            close = text + 1 + (text[1] == '!' || text[1] == '^');
+            close = close < end ? memchr(close + 1, ']', end - close - 1) : NULL;
+        }
+        if(close != NULL){
+            segment->type = SEGMENT_PATTERN;
+            part->type = GLOB_CLASS;
+            memset(part->set, 0, sizeof(part->set));
+            text++;
+            negate = *text == '!' || *text == '^';
+            text += negate;
+            do{
+                if(*text == '\\' && text + 1 < close){
+                    text++;
+                }
+                low = (unsigned char)*text++;
+                c = low;
+                if(*text == '-' && text + 1 < close){
+                    c = (unsigned char)text[1];
+                    text += 2;
+                }
+                for(; low <= c; low++){
+                    part->set[low >> 3] |= 1 << (low & 7);
+                }
+            } while(text < close);
+            if(negate){
+                for(c = 0; c < 32; c++){
+                    part->set[c] = ~part->set[c];
+                }
+            }
+            text = close + 1;
+            segment->numParts++;
+            continue;
+        }
+
+        // a run of ordinary characters, with escapes removed
+        part->type = GLOB_LITERAL;
+        part->text = literal + literalLen;
+        while(text < end && *text != '*' && *text != '?' && *text != '['){
+            if(*text == '\\' && text + 1 < end){
+                text++;
+            }
+            literal[literalLen++] = *text++;
+        }
+        if(text < end && *text == '[' && literal + literalLen == part->text){
+            literal[literalLen++] = *text++;
+        }
+        part->len = literal + literalLen - part->text;
+        if(segment->numParts > 0 && part[-1].type == GLOB_LITERAL){
+            part[-1].len += part->len;
+        } else {
+            segment->numParts++;
+        }
+    }
+    literal[literalLen] = '\0';
+
+    if(segment->numParts > 1 && segment->parts[segment->numParts - 1].type == GLOB_LITERAL){
+        segment->suffix = segment->parts[segment->numParts - 1].text;
+        segment->suffixLen = segment->parts[segment->numParts - 1].len;
+    }
+}
+
+/*
+// Return 1 if name matches a compiled segment.
+// A * first matches nothing and takes one more character each time what follows it fails to match.
+*/
+static int matchSegment(struct globSegment* segment, char* name){
+    struct globPart* parts = segment->parts;
+    int numParts = segment->numParts;
+    int part = 0;
+    int starPart = -1;
+    char* starName = NULL;
+    size_t len;
+
+    if(segment->suffix != NULL){
+        len = strlen(name);
+        if(len < segment->suffixLen || memcmp(name + len - segment->suffixLen, segment->suffix, segment->suffixLen) != 0){
+            return 0;
+        }
+    }
+
+    while(part < numParts || *name != '\0'){
+        if(part < numParts){
+            switch(parts[part].type){
+                case GLOB_STAR:
+                    starPart = part++;
+                    starName = name;
+                    continue;
+                case GLOB_LITERAL:
+                    if(strncmp(name, parts[part].text, parts[part].len) == 0){
+                        name += parts[part].len;
+                        part++;
+                        continue;
+                    }
+                    break;
+                case GLOB_ANY:
+                    if(*name != '\0'){
+                        name++;
+                        part++;
+                        continue;
+                    }
+                    break;
+                default:
+                    if(*name != '\0' && (parts[part].set[(unsigned char)*name >> 3] & (1 << (*name & 7)))){
+                        name++;
+                        part++;
+                        continue;
+                    }
+            }
+        }
+        if(starPart == -1 || *starName == '\0'){
+            return 0;
+        }
+        starName++;
+        name = starName;
+        part = starPart + 1;
+    }
+    return 1;
+}
+
+static void addMatch(struct globState* state, char* path){
+    if(state->numMatches == state->capacity){
+        state->matches = arenaGrow(state->cache->arena, state->matches, state->capacity * sizeof(char*),
+                                   state->capacity * 2 * sizeof(char*));
+        state->capacity *= 2;
+    }
+    state->matches[state->numMatches++] = path;
+}
+
+/*
+// Return the next entry of a listing after *offset, advancing *offset, or NULL at the end.
+// . and .. are skipped, and so are other names starting with '.' unless hidden is set.
+*/
+static struct dirent64* nextEntry(struct globDir* dir, size_t* offset, int hidden){
+    struct dirent64* entry;
+
+    while(*offset < dir->len){
+        entry = (struct dirent64*)(dir->entries + *offset);
+        *offset += entry->d_reclen;
+        if(entry->d_name[0] != '.' || (hidden && strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)){
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void matchFrom(struct globState* state, int index, char* path);
+
+/*
+// Match the segments after a ** at index in path and in every directory below it, except hidden ones
+*/
+static void matchGlobstar(struct globState* state, int index, char* path){
+    struct arena* arena = state->cache->arena;
+    struct globDir* dir;
+    struct dirent64* entry;
+    size_t offset = 0;
+    int last = index == state->numSegments - 1;
+
+    // a ** at the end matches every file and directory below path
+    if(!last){
+        matchFrom(state, index + 1, path);
+    }
+    dir = listDirectory(state->cache, path);
+    while((entry = nextEntry(dir, &offset, 0)) != NULL){
+        int directory = isDirectory(arena, dir, entry, 0);
+        if(last && (directory || !state->dirOnly)){
+            addMatch(state, joinPath(arena, path, entry->d_name, state->dirOnly ? "/" : ""));
+        }
+        if(directory){
+            matchGlobstar(state, index, joinPath(arena, path, entry->d_name, ""));
+        }
+    }
+}
+
+/*
+// Add the paths that match the segments from index onwards, starting in the directory at path
+*/
+static void matchFrom(struct globState* state, int index, char* path){
+    struct arena* arena = state->cache->arena;
+    struct globSegment* segment = &state->segments[index];
+    int last = index == state->numSegments - 1;
+    struct globDir* dir;
+    struct dirent64* entry;
+    struct stat info;
+    size_t offset = 0;
+    char* next;
+
+    if(segment->type == SEGMENT_GLOBSTAR){
+        matchGlobstar(state, index, path);
+        return;
+    }
+
+    if(segment->type == SEGMENT_LITERAL){
+        // a segment without pattern characters is not looked up in a listing, only checked for at the end
+        next = joinPath(arena, path, segment->text, "");
+        if(!last){
+            matchFrom(state, index + 1, next);
+        } else if((state->dirOnly ? stat(next, &info) == 0 && S_ISDIR(info.st_mode) : lstat(next, &info) == 0)){
+            addMatch(state, state->dirOnly ? joinPath(arena, path, segment->text, "/") : next);
+        }
+        return;
+    }
+
+    dir = listDirectory(state->cache, path);
+    while((entry = nextEntry(dir, &offset, segment->hidden)) != NULL){
+        if(!matchSegment(segment, entry->d_name)){
+            continue;
+        }
+        if(last && !state->dirOnly){
+            addMatch(state, joinPath(arena, path, entry->d_name, ""));
+        } else if(isDirectory(arena, dir, entry, 1)){
+            if(last){
+                addMatch(state, joinPath(arena, path, entry->d_name, "/"));
+            } else {
+                matchFrom(state, index + 1, joinPath(arena, path, entry->d_name, ""));
+            }
+        }
+    }
+}
+
+static int comparePaths(const void* a, const void* b){
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/*
+// Expand a pattern into the paths that match it, sorted, in *matches. A backslash in pattern escapes the
+// character after it. Returns the number of matches, 0 if there are none or pattern has nothing to expand.
+// Everything is allocated from the cache's arena, and directories are read through the cache.
+*/
+int expandGlob(struct globCache* cache, char* pattern, char*** matches){
+    struct globState state;
+    char* start = pattern;
+    char* end;
+    size_t len = strlen(pattern);
+    char* root = "";
+    int expands = 0;
+
+    state.cache = cache;
+    state.segments = arenaAlloc(cache->arena, (len / 2 + 2) * sizeof(struct globSegment));
+    state.numSegments = 0;
+    state.dirOnly = len > 0 && pattern[len - 1] == '/';
+    state.numMatches = 0;
+    state.capacity = 16;
+    state.matches = arenaAlloc(cache->arena, state.capacity * sizeof(char*));
+
+    if(*start == '/'){
+        root = "/";
+        start += strspn(start, "/");
+    }
+    while(*start != '\0'){
+        end = strchr(start, '/');
+        if(end == NULL){
+            end = start + strlen(start);
+        }
+        compileSegment(cache->arena, &state.segments[state.numSegments], start, end);
+        expands |= state.segments[state.numSegments].type != SEGMENT_LITERAL;
+        state.numSegments++;
+        start = end + strspn(end, "/");
+    }
+    // a lone '[', as in [ -f file ], is not a pattern
+    if(!expands){
+        return 0;
+    }
+
+    matchFrom(&state, 0, root);
+    qsort(state.matches, state.numMatches, sizeof(char*), comparePaths);
+    *matches = state.matches;
+    return state.numMatches;
+}
@@ -0,0 +1,485 @@
+/***************************************
+ * Smallsh: command history
+ * The history is an append-only file of lines, $HISTFILE or ~/.smallsh_history, shared by every smallsh.
+ * At startup the file is only mapped, so starting does not take longer as it grows. The offsets of its entries
+ * and a sorted index for prefix searches are built the first time they are needed, and extended as the file grows.
+***************************************/
+#include "smallsh.h"
+#include <sys/uio.h>
+#include <limits.h>
+
+#define HISTORY_RECENT 1024         // newest entries searched one by one before the sorted index is used
+#define HISTORY_BLOCK 64            // entries of the sorted index covered by each element of blockMax
+#define HISTORY_WINDOW 1024         // entries searched at a time by a substring search, newest first
+
+/*
+// State of the history. Entry i starts at offset starts[i] of the file and ends with the '\n' before starts[i + 1].
+*/
+static struct {
+    int fd;                     // history file opened for appending, -1 if there is no history
+    char* data;                 // mapping of the file, NULL if nothing is mapped
+    size_t mappedLen;
+    size_t* starts;             // starts[count] is the end of the last complete entry
+    int count;
+    int capacity;
+    int* sorted;                // the first sortedCount entries, sorted by text and then by number
+    int sortedCount;
+    int* blockMax;              // highest entry number in each block of HISTORY_BLOCK entries of sorted
+    char* expanded;             // the last line with history references replaced
+    size_t expandedCapacity;
+} history = {-1};
+
+/*
+// Open the history file. Nothing is read until the history is first used.
+// HISTFILE set to an empty string turns the history off.
+*/
+void openHistory(){
+    char* path = getVariable(shellVariables, "HISTFILE");
+    char* home = getVariable(shellVariables, "HOME");
+    char defaultPath[PATH_MAX];
+
+    if(path == NULL){
+        if(home == NULL){
+            return;
+        }
+        snprintf(defaultPath, sizeof(defaultPath), "%s/.smallsh_history", home);
+        path = defaultPath;
+    }
+    if(path[0] == '\0'){
+        return;
+    }
+    history.fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if(history.fd == -1){
+        perror(path);
+        return;
+    }
+    history.capacity = 1024;
+    history.starts = malloc(history.capacity * sizeof(size_t));
+    history.starts[0] = 0;
+}
+
+/*
+// Unmap the history and free its indexes
+*/
+void closeHistory(){
+    if(history.data != NULL){
+        munmap(history.data, history.mappedLen);
+    }
+    if(history.fd != -1){
+        close(history.fd);
+    }
+    free(history.starts);
+    free(history.sorted);
+    free(history.blockMax);
+    free(history.expanded);
+    memset(&history, 0, sizeof(history));
+    history.fd = -1;
+}
+
+/*
+// Map what other shells and this one appended to the file since it was last mapped, and index its entries.
+// A line that is still being written, without its '\n', is left for later.
+*/
+static void refreshHistory(){
+    struct stat info;
+    char* data;
+    char* next;
+    char* end;
+
+    if(history.fd == -1 || fstat(history.fd, &info) == -1 || (size_t)info.st_size <= history.mappedLen){
+        return;
+    }
+    if(history.data == NULL){
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, history.fd, 0);
+    } else {
+        data = mremap(history.data, history.mappedLen, info.st_size, MREMAP_MAYMOVE);
+    }
+    if(data == MAP_FAILED){
+        return;
+    }
+    history.data = data;
+    history.mappedLen = info.st_size;
+
+    // index the new complete lines, scanning for '\n' from the end of the last one
+    next = data + history.starts[history.count];
+    end = data + history.mappedLen;
+    while(next < end && (next = memchr(next, '\n', end - next)) != NULL){
+        next++;
+        if(history.count + 1 == history.capacity){
+            history.capacity *= 2;
+            history.starts = realloc(history.starts, history.capacity * sizeof(size_t));
+        }
+        history.count++;
+        history.starts[history.count] = next - data;
+    }
+}
+
+/*
+// Return the text of entry i and set *len to its length, without the '\n'
+*/
+static char* entryText(int i, size_t* len){
+    *len = history.starts[i + 1] - history.starts[i] - 1;
+    return history.data + history.starts[i];
+}
+
+/*
+// Append a line to the history file. The line and its '\n' are written with a single write to a file opened
+// with O_APPEND, so lines from shells writing at the same time are never mixed.
+*/
+void addHistory(char* line){
+    struct iovec parts[2];
+    size_t len = strcspn(line, "\n");
+
+    if(history.fd == -1 || line[strspn(line, " \t\n")] == '\0'){
+        return;
+    }
+    parts[0].iov_base = line;
+    parts[0].iov_len = len;
+    parts[1].iov_base = "\n";
+    parts[1].iov_len = 1;
+    while(writev(history.fd, parts, 2) == -1 && errno == EINTR);
+}
+
+/*
+// Order entries by text, then by number
+*/
+static int compareEntries(const void* a, const void* b){
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    size_t xLen, yLen;
+    char* xText = entryText(x, &xLen);
+    char* yText = entryText(y, &yLen);
+    int order = memcmp(xText, yText, xLen < yLen ? xLen : yLen);
+
+    if(order == 0){
+        order = (xLen > yLen) - (xLen < yLen);
+    }
+    return order != 0 ? order : (x > y) - (x < y);
+}
+
+/*
+// Add the entries the sorted index does not cover yet. Only the new entries are sorted, then they are merged in
+// from the end of the index, and blockMax is recomputed from the first block a new entry moved into.
+*/
+static void buildSortedIndex(){
+    int numBlocks = (history.count + HISTORY_BLOCK - 1) / HISTORY_BLOCK;
+    int numNew = history.count - history.sortedCount;
+    int* added = malloc((numNew + 1) * sizeof(int));
+    int old = history.sortedCount - 1;
+    int next = numNew - 1;
+    int to = history.count;
+    int i;
+
+    history.sorted = realloc(history.sorted, (history.count + 1) * sizeof(int));
+    history.blockMax = realloc(history.blockMax, (numBlocks + 1) * sizeof(int));
+    for(i = 0; i < numNew; i++){
+        added[i] = history.sortedCount + i;
+    }
+    qsort(added, numNew, sizeof(int), compareEntries);
+
+    // every old entry above the lowest new one moves up, the ones below it stay where they are
+    while(next >= 0){
+        to--;
+        if(old >= 0 && compareEntries(&history.sorted[old], &added[next]) > 0){
+            history.sorted[to] = history.sorted[old--];
+        } else {
+            history.sorted[to] = added[next--];
+        }
+    }
+    free(added);
+
+    for(i = to - to % HISTORY_BLOCK; i < history.count; i++){
+        if(i % HISTORY_BLOCK == 0 || history.sorted[i] > history.blockMax[i / HISTORY_BLOCK]){
+            history.blockMax[i / HISTORY_BLOCK] = history.sorted[i];
+        }
+    }
+    history.sortedCount = history.count;
+}
+
+/*
+// Return 1 if entry i starts with the len characters of prefix
+*/
+static int hasPrefix(int i, char* prefix, size_t len){
+    size_t entryLen;
+    char* text = entryText(i, &entryLen);
+
+    return entryLen >= len && memcmp(text, prefix, len) == 0;
+}
+
+/*
+// Find the range [*first, *last) of the sorted index whose entries start with prefix
+*/
+static void prefixRange(char* prefix, size_t len, int* first, int* last){
+    size_t entryLen;
+    char* text;
+    int low = 0;
+    int high = history.sortedCount;
+    int middle;
+
+    // the first entry that is not less than prefix
+    while(low < high){
+        middle = (low + high) / 2;
+        text = entryText(history.sorted[middle], &entryLen);
+        if(memcmp(text, prefix, entryLen < len ? entryLen : len) < 0 || (entryLen < len && memcmp(text, prefix, entryLen) == 0)){
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *first = low;
+
+    // the entries that start with prefix follow it
+    high = history.sortedCount;
+    while(low < high){
+        middle = (low + high) / 2;
+        if(hasPrefix(history.sorted[middle], prefix, len)){
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *last = low;
+}
+
+/*
+// Return the newest entry that starts with prefix, or -1 if there is none.
+// The newest entries are checked one by one, since the entry wanted is usually recent. Older ones are found
+// through the sorted index, which is built or extended here when it does not cover them.
+*/
+static int findPrefix(char* prefix, size_t len){
+    int oldest = history.count > HISTORY_RECENT ? history.count - HISTORY_RECENT : 0;
+    int newest = -1;
+    int first;
+    int last;
+    int i;
+
+    for(i = history.count - 1; i >= oldest; i--){
+        if(hasPrefix(i, prefix, len)){
+            return i;
+        }
+    }
+    if(oldest == 0){
+        return -1;
+    }
+    if(history.sortedCount < oldest){
+        buildSortedIndex();
+    }
+
+    // the highest entry number in the range, from whole blocks where the range covers them
+    prefixRange(prefix, len, &first, &last);
+    for(i = first; i < last; i++){
+        if(i % HISTORY_BLOCK == 0 && i + HISTORY_BLOCK <= last){
+            if(history.blockMax[i / HISTORY_BLOCK] > newest){
+                newest = history.blockMax[i / HISTORY_BLOCK];
+            }
+            i += HISTORY_BLOCK - 1;
+        } else if(history.sorted[i] > newest){
+            newest = history.sorted[i];
+        }
+    }
+    return newest;
+}
+
+/*
+// Return the entry that contains the byte at offset
+*/
+static int entryAt(size_t offset){
+    int low = 0;
+    int high = history.count;
+    int middle;
+
+    while(high - low > 1){
+        middle = (low + high) / 2;
+        if(history.starts[middle] <= offset){
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/*
+// Return the newest entry that contains text, or -1 if there is none.
+// Windows of entries are searched with memmem(), newest first. An entry never contains a '\n', so a match
+// never spans two entries.
+*/
+static int findSubstring(char* text, size_t len){
+    char* start;
+    char* end;
+    char* match;
+    char* found;
+    int last = history.count;
+    int first;
+
+    while(last > 0){
+        first = last > HISTORY_WINDOW ? last - HISTORY_WINDOW : 0;
+        start = history.data + history.starts[first];
+        end = history.data + history.starts[last];
+        found = NULL;
+        while(start < end && (match = memmem(start, end - start, text, len)) != NULL){
+            found = match;
+            start = match + 1;
+        }
+        if(found != NULL){
+            return entryAt(found - history.data);
+        }
+        last = first;
+    }
+    return -1;
+}
+
+/*
+// Print entry i with its number
+*/
+static void printEntry(int i){
+    size_t len;
+    char* text = entryText(i, &len);
+
+    printf("%5d  ", i + 1);
+    fwrite(text, 1, len, stdout);
+    putchar('\n');
+}
+
+static int compareInts(const void* a, const void* b){
+    return (*(const int*)a > *(const int*)b) - (*(const int*)a < *(const int*)b);
+}
+
+/*
+// The history builtin lists the history with entry numbers.
+// Usage: history [n] prints everything or the last n entries, history -p prefix the entries that start with prefix,
+// history -s text the entries that contain text.
+*/
+void smallsh_history(struct command* smallsh_command){
+    char** args = smallsh_command->args;
+    int* matches;
+    int first;
+    int last;
+    int i;
+    char* match;
+    char* start;
+    char* end;
+
+    exitStatus = 0;
+    if(history.fd == -1){
+        return;
+    }
+    refreshHistory();
+    if(args[1] != NULL && strcmp(args[1], "-p") == 0 && args[2] != NULL){
+        // every match is in the sorted index once it covers every entry
+        if(history.sortedCount < history.count){
+            buildSortedIndex();
+        }
+        prefixRange(args[2], strlen(args[2]), &first, &last);
+        matches = malloc((last - first + 1) * sizeof(int));
+        memcpy(matches, history.sorted + first, (last - first) * sizeof(int));
+        qsort(matches, last - first, sizeof(int), compareInts);
+        for(i = 0; i < last - first; i++){
+            printEntry(matches[i]);
+        }
+        free(matches);
+    } else if(args[1] != NULL && strcmp(args[1], "-s") == 0 && args[2] != NULL){
+        start = history.data;
+        end = history.data + history.starts[history.count];
+        while(start < end && (match = memmem(start, end - start, args[2], strlen(args[2]))) != NULL){
+            i = entryAt(match - history.data);
+            printEntry(i);
+            start = history.data + history.starts[i + 1];
+        }
+    } else if(args[1] == NULL || (isdigit((unsigned char)args[1][0]) && args[2] == NULL)){
+        i = args[1] != NULL ? history.count - atoi(args[1]) : 0;
+        for(i = i > 0 ? i : 0; i < history.count; i++){
+            printEntry(i);
+        }
+    } else {
+        fprintf(stderr, "usage: history [n] | -p prefix | -s text\n");
+        fflush(stderr);
+        exitStatus = 2;
+    }
+    fflush(stdout);
+}
+
+/*
+// Append len bytes of text to the expanded line
+*/
+static void appendExpanded(size_t* used, const char* text, size_t len){
+    if(*used + len + 1 > history.expandedCapacity){
+        history.expandedCapacity = (*used + len + 1) * 2;
+        history.expanded = realloc(history.expanded, history.expandedCapacity);
+    }
+    memcpy(history.expanded + *used, text, len);
+    *used += len;
+}
+
+/*
+// Replace the history references in a line read at the prompt with the entries they refer to:
+//  !!          the last entry
+//  !n, !-n     entry n, or the nth entry from the end
+//  !prefix     the newest entry that starts with prefix
+//  !?text[?]   the newest entry that contains text
+// A '!' between single quotes, after a backslash or '$', or followed by a blank, '=', '(' or '"' is left as it is.
+// Returns line itself if it has no references, otherwise the expanded line, which is valid until the next call.
+// Returns NULL and prints an error if a reference matches no entry.
+*/
+char* expandHistory(char* line){
+    size_t used = 0;
+    size_t len;
+    char* text = line;
+    char* bang;
+    char* end;
+    char* entry;
+    int quoted = 0;
+    int event;
+
+    if(history.fd == -1 || strchr(line, '!') == NULL){
+        return line;
+    }
+    refreshHistory();
+
+    for(bang = line; *bang != '\0'; bang++){
+        if(*bang == '\'' ){
+            quoted = !quoted;
+        }
+        if(quoted || *bang != '!' || (bang > line && (bang[-1] == '\\' || bang[-1] == '$'))
+           || strchr(" \t\n=(\"", bang[1]) != NULL){
+            continue;
+        }
+
+        end = bang + 1;
+        if(*end == '!'){
+            event = history.count - 1;
+            end++;
+        } else if(isdigit((unsigned char)*end) || (*end == '-' && isdigit((unsigned char)end[1]))){
+            event = strtol(end, &end, 10);
+            event = event < 0 ? history.count + event : event - 1;
+        } else if(*end == '?'){
+            len = strcspn(end + 1, "?\n");
+            event = len > 0 ? findSubstring(end + 1, len) : -1;
+            end += len + 1;
+            if(*end == '?'){
+                end++;
+            }
+        } else {
+            len = strcspn(end, " \t\n;&|<>\"");
+            event = findPrefix(end, len);
+            end += len;
+        }
+
+        if(event < 0 || event >= history.count){
+            fprintf(stderr, "smallsh: %.*s: event not found\n", (int)(end - bang), bang);
+            fflush(stderr);
+            return NULL;
+        }
+        appendExpanded(&used, text, bang - text);
+        entry = entryText(event, &len);
+        appendExpanded(&used, entry, len);
+        text = end;
+        bang = end - 1;
+    }
+    if(text == line){
+        return line;
+    }
+    appendExpanded(&used, text, strlen(text));
+    history.expanded[used] = '\0';
+    return history.expanded;
+}
@@ -0,0 +1,223 @@
+/***************************************
+ * Smallsh: reading commands from stdin, a script or -c
+***************************************/
+#include "smallsh.h"
+
+/*
+// Open a script for batch mode.
+// A regular file is mapped with mmap(), anything else (such as a pipe) is read into memory with large reads.
+// Returns NULL and prints an error if the script cannot be read.
+*/
+struct batchInput* openScript(char* path){
+    struct batchInput* input;
+    struct stat info;
+    size_t capacity;
+    ssize_t numRead;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if(fd == -1){
+        perror(path);
+        return NULL;
+    }
+
+    input = calloc(1, sizeof(struct batchInput));
+    input->path = strdup(path);
+    if(fstat(fd, &info) == 0){
+        input->info = info;
+    }
+    if(S_ISREG(input->info.st_mode) && info.st_size > 0){
+        input->data = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(input->data != MAP_FAILED){
+            madvise(input->data, info.st_size, MADV_SEQUENTIAL);
+            input->len = info.st_size;
+            input->mapped = 1;
+            close(fd);
+            return input;
+        }
+    }
+
+    // read the whole script, doubling the buffer as needed
+    capacity = 1 << 16;
+    input->data = malloc(capacity);
+    while((numRead = read(fd, input->data + input->len, capacity - input->len)) != 0){
+        if(numRead == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            perror(path);
+            break;
+        }
+        input->len += numRead;
+        if(input->len == capacity){
+            capacity *= 2;
+            input->data = realloc(input->data, capacity);
+        }
+    }
+    close(fd);
+    return input;
+}
+
+/*
+// Use the argument of -c as the input for batch mode. It can hold several lines.
+*/
+struct batchInput* openCommandString(char* commands){
+    struct batchInput* input = calloc(1, sizeof(struct batchInput));
+
+    input->data = strdup(commands);
+    input->len = strlen(commands);
+    return input;
+}
+
+/*
+// Free all memory associated with batch input
+*/
+void closeBatchInput(struct batchInput* input){
+    if(input != NULL){
+        if(input->mapped){
+            munmap(input->data, input->len);
+        } else {
+            free(input->data);
+        }
+        free(input->lastLine);
+        free(input->path);
+        free(input);
+    }
+}
+
+/*
+// Get the next line of batch input. The '\n' that ends the line is replaced with '\0'.
+// Returns NULL at the end of the input.
+*/
+char* getBatchLine(struct batchInput* input){
+    char* line = input->data + input->pos;
+    char* newline;
+
+    if(input->pos >= input->len){
+        return NULL;
+    }
+
+    newline = memchr(line, '\n', input->len - input->pos);
+    if(newline != NULL){
+        *newline = '\0';
+        input->pos = newline - input->data + 1;
+        return line;
+    }
+
+    // the last line has no '\n' and there may be no room to terminate it in place
+    input->lastLine = malloc(input->len - input->pos + 1);
+    memcpy(input->lastLine, line, input->len - input->pos);
+    input->lastLine[input->len - input->pos] = '\0';
+    input->pos = input->len;
+    return input->lastLine;
+}
+
+/*
+// Bytes read from stdin in interactive mode that have not been returned yet
+*/
+static char* stdinData = NULL;
+static size_t stdinStart = 0;       // first byte not returned yet
+static size_t stdinLen = 0;         // end of the bytes read
+static size_t stdinCapacity = 0;
+
+/*
+// Read more of stdin into the buffer, waiting in the event loop until it is readable.
+// Bytes that were already returned are dropped first. Returns the number of bytes read, 0 at the end of the input.
+*/
+static ssize_t fillStdin(char* prompt){
+    ssize_t numRead;
+
+    if(stdinStart > 0){
+        memmove(stdinData, stdinData + stdinStart, stdinLen - stdinStart);
+        stdinLen -= stdinStart;
+        stdinStart = 0;
+    }
+    if(stdinCapacity - stdinLen < 1024){
+        stdinCapacity = stdinCapacity == 0 ? 4096 : stdinCapacity * 2;
+        stdinData = realloc(stdinData, stdinCapacity);
+    }
+
+    while(1){
+        waitForInput(prompt);
+        numRead = read(STDIN_FILENO, stdinData + stdinLen, stdinCapacity - stdinLen - 1);
+        if(numRead >= 0){
+            stdinLen += numRead;
+            return numRead;
+        }
+        if(errno != EINTR && errno != EAGAIN){
+            return 0;
+        }
+    }
+}
+
+/*
+// Replace the history references in a line typed at the prompt and add it to the history.
+// The expanded line is echoed, as in sh. A line with a reference that matches nothing is replaced by an empty line.
+*/
+static char* recordLine(char* line){
+    static char emptyLine[1];
+    char* expanded = expandHistory(line);
+
+    if(expanded == NULL){
+        emptyLine[0] = '\0';
+        return emptyLine;
+    }
+    if(expanded != line){
+        printf("%s\n", expanded);
+        fflush(stdout);
+    }
+    addHistory(expanded);
+    return expanded;
+}
+
+/*
+// Get the user's input.
+// Prints prompt and returns the user's input as a char*, without the '\n' that ends it.
+// While waiting for input, background processes that finish are reported and SIGTSTP is handled.
+// The line is stored in a buffer that is reused for every line, so it is only valid until the next call.
+// Lines typed at the prompt are added to the history after their history references are replaced.
+// In batch mode the next line of the script is returned instead, without printing a prompt.
+*/
+char* getInput(char* prompt){
+    char* line;
+    char* newline;
+
+    if(batch != NULL){
+        return getBatchLine(batch);
+    }
+
+    printf("%s", prompt);
+    fflush(stdout);
+
+    while(1){
+        line = stdinData + stdinStart;
+        newline = stdinLen > stdinStart ? memchr(line, '\n', stdinLen - stdinStart) : NULL;
+        if(newline != NULL){
+            *newline = '\0';
+            stdinStart = newline - stdinData + 1;
+            return recordLine(line);
+        }
+        if(fillStdin(prompt) == 0){
+            break;
+        }
+    }
+
+    // the end of the input, return the last line if it has no '\n', fillStdin() left room to terminate it
+    if(stdinLen == stdinStart){
+        return NULL;
+    }
+    line = stdinData + stdinStart;
+    stdinData[stdinLen] = '\0';
+    stdinStart = stdinLen;
+    return recordLine(line);
+}
+
+/*
+// Read one character of interactive input from the same buffer as getInput().
+// Returns EOF at the end of the input.
+*/
+int readInputChar(){
+    if(stdinStart == stdinLen && fillStdin("") == 0){
+        return EOF;
+    }
+    return (unsigned char)stdinData[stdinStart++];
+}
@@ -0,0 +1,279 @@
+/***************************************
+ * Smallsh: table of background jobs
+***************************************/
+#include "smallsh.h"
+
+/*
+// Allocate memory and initialize an empty job table
+*/
+struct jobTable* initJobTable(){
+    struct jobTable* table = malloc(sizeof(struct jobTable));
+
+    table->capacity = 16;
+    table->slots = calloc(table->capacity, sizeof(struct job));
+    table->used = 0;
+    table->count = 0;
+    table->freeHead = -1;
+
+    table->pids = initPidMap();
+    return table;
+}
+
+/*
+// Free all memory associated with a job table
+*/
+void freeJobTable(struct jobTable* table){
+    int i;
+
+    if(table != NULL){
+        for(i = 0; i < table->used; i++){
+            free(table->slots[i].commandLine);
+            free(table->slots[i].policy);
+        }
+        free(table->slots);
+        freePidMap(table->pids);
+        free(table);
+    }
+}
+
+/*
+// Add a background job to the table.
+// Takes the pids of the job's processes, the first of which is the process group id, a copy of its command line
+// and a description of its launch policy, or NULL. Returns the job number.
+*/
+int addJob(struct jobTable* table, pid_t* pids, int numPids, char* commandLine, char* policy){
+    int i;
+    int slot;
+
+    if(table->freeHead != -1){
+        // reuse the most recently freed slot
+        slot = table->freeHead;
+        table->freeHead = table->slots[slot].nextFree;
+    } else {
+        if(table->used == table->capacity){
+            table->capacity *= 2;
+            table->slots = realloc(table->slots, table->capacity * sizeof(struct job));
+            memset(table->slots + table->used, 0, (table->capacity - table->used) * sizeof(struct job));
+        }
+        slot = table->used;
+        table->used++;
+    }
+
+    table->slots[slot].pid = pids[0];
+    table->slots[slot].lastPid = pids[numPids - 1];
+    table->slots[slot].remaining = numPids;
+    table->slots[slot].status = 0;
+    table->slots[slot].commandLine = commandLine;
+    table->slots[slot].policy = policy;
+    table->slots[slot].nextFree = -1;
+    for(i = 0; i < numPids; i++){
+        pidMapInsert(table->pids, pids[i], slot);
+    }
+    table->count++;
+
+    return slot + 1;
+}
+
+/*
+// Find a job by the pid of any of its processes. Returns the job's slot or -1 if there is no job with that pid.
+*/
+int findJobByPid(struct jobTable* table, pid_t pid){
+    return pidMapGet(table->pids, pid);
+}
+
+/*
+// Find a job by job number. Returns the job's slot or -1 if there is no such job.
+*/
+int findJobByNumber(struct jobTable* table, int jobNumber){
+    if(jobNumber < 1 || jobNumber > table->used || table->slots[jobNumber - 1].pid == 0){
+        return -1;
+    }
+    return jobNumber - 1;
+}
+
+/*
+// Remove the job in slot from the table and put the slot on the free list.
+// A job is normally removed once all of its processes were reaped. If any were not, their pids are found by scanning the index.
+*/
+void removeJob(struct jobTable* table, int slot){
+    int i;
+
+    for(i = 0; table->slots[slot].remaining > 0 && i < table->pids->capacity; i++){
+        if(table->pids->entries[i].value == slot){
+            pidMapRemoveBucket(table->pids, i);
+            table->slots[slot].remaining--;
+            i--;
+        }
+    }
+
+    free(table->slots[slot].commandLine);
+    free(table->slots[slot].policy);
+    table->slots[slot].commandLine = NULL;
+    table->slots[slot].policy = NULL;
+    table->slots[slot].pid = 0;
+    table->slots[slot].nextFree = table->freeHead;
+    table->freeHead = slot;
+    table->count--;
+
+    // start numbering jobs from 1 again once the table is empty
+    if(table->count == 0){
+        table->used = 0;
+        table->freeHead = -1;
+    }
+}
+
+/*
+// Record that a process of a background job finished.
+// When it was the last process of its job, prints how the job finished and removes it from the job table.
+// Returns the job's slot if the job finished, otherwise -1.
+*/
+int reportJob(struct jobTable* table, pid_t childPid, int childStatus){
+    int slot = pidMapRemove(table->pids, childPid);
+    struct job* job;
+
+    if(slot == -1){
+        return -1;
+    }
+    job = &table->slots[slot];
+    job->remaining--;
+    if(childPid == job->lastPid){
+        job->status = childStatus;
+    }
+    if(job->remaining > 0){
+        return -1;
+    }
+
+    if(WIFEXITED(job->status)){
+        printf("background process %d terminated: exit status %d\n", job->pid, WEXITSTATUS(job->status));
+    } else {
+        printf("background process %d terminated by signal: %d\n", job->pid, WTERMSIG(job->status));
+    }
+    fflush(stdout);
+
+    removeJob(table, slot);
+    return slot;
+}
+
+/*
+// Reap every background process that has finished without blocking.
+// Only finished children are visited, so the cost does not depend on how many jobs are running.
+// Returns the number of jobs that finished.
+*/
+int reapJobs(struct jobTable* table){
+    int childStatus;
+    int finished = 0;
+    pid_t childPid;
+    struct rusage usage;
+
+    while(table->count > 0 && (childPid = wait4(-1, &childStatus, WNOHANG, &usage)) > 0){
+        statsReaped(commandStats, childPid, childStatus, &usage);
+        if(reportJob(table, childPid, childStatus) != -1){
+            finished++;
+        }
+    }
+    return finished;
+}
+
+/*
+// Wait for every process of a foreground pipeline to finish, storing the wait status of pids[i] in statuses[i].
+// Background jobs that finish in the meantime are reaped and reported right away.
+// The resource usage of the pipeline's processes is added to total.
+*/
+void waitPipeline(struct jobTable* table, pid_t* pids, int numPids, int* statuses, struct rusage* total){
+    int childStatus;
+    int remaining = 0;
+    int i;
+    pid_t childPid;
+    struct rusage usage;
+
+    for(i = 0; i < numPids; i++){
+        if(pids[i] != -1){
+            remaining++;
+        }
+    }
+    while(remaining > 0){
+        childPid = wait4(-1, &childStatus, WNOHANG, &usage);
+        if(childPid == 0){
+            waitForChild();
+            continue;
+        }
+        if(childPid == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            return;
+        }
+        statsReaped(commandStats, childPid, childStatus, &usage);
+        for(i = 0; i < numPids && pids[i] != childPid; i++);
+        if(i < numPids){
+            statuses[i] = childStatus;
+            addUsage(total, &usage);
+            remaining--;
+        } else {
+            reportJob(table, childPid, childStatus);
+        }
+    }
+}
+
+/*
+// Wait for every process of the job in slot to finish and remove it from the table.
+// Returns the wait status of the job.
+*/
+int waitJob(struct jobTable* table, int slot){
+    int childStatus;
+    pid_t childPid;
+    pid_t pgid = table->slots[slot].pid;
+    struct rusage usage;
+
+    while((childPid = wait4(-pgid, &childStatus, 0, &usage)) > 0){
+        statsReaped(commandStats, childPid, childStatus, &usage);
+        if(reportJob(table, childPid, childStatus) == slot){
+            return table->slots[slot].status;
+        }
+    }
+    // the processes are gone, forget the job
+    childStatus = table->slots[slot].status;
+    removeJob(table, slot);
+    return childStatus;
+}
+
+/*
+// Join the arguments of every stage of a command into a single line for the job table
+*/
+char* commandLine(struct command* smallsh_command){
+    int i;
+    size_t len = 0;
+    char* line;
+    struct command* stage;
+
+    for(stage = smallsh_command; stage != NULL; stage = stage->next){
+        for(i = 0; i < stage->argc; i++){
+            len += strlen(stage->args[i]) + 1;
+        }
+        len += 2;
+    }
+    line = calloc(len + 1, sizeof(char));
+    for(stage = smallsh_command; stage != NULL; stage = stage->next){
+        if(stage != smallsh_command){
+            strcat(line, " | ");
+        }
+        for(i = 0; i < stage->argc; i++){
+            if(i > 0){
+                strcat(line, " ");
+            }
+            strcat(line, stage->args[i]);
+        }
+    }
+    return line;
+}
+
+/*
+// Convert a status from waitpid() to the exit code reported by status and $?.
+// A process killed by a signal reports 128 plus the signal number.
+*/
+int exitCode(int childStatus){
+    if(WIFSIGNALED(childStatus)){
+        return 128 + WTERMSIG(childStatus);
+    }
+    return WEXITSTATUS(childStatus);
+}
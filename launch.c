@@ -0,0 +1,397 @@
+/***************************************
+ * Smallsh: starting external commands and pipelines
+***************************************/
+#include "smallsh.h"
+
+/*Handle SIGINT in child foreground processes*/
+void foreground_SIGINT(int num){
+    exit(0);
+}
+
+/*
+// Return the environment to launch a command with: its own if it has assignments, otherwise the exported variables
+*/
+static char** commandVariables(struct command* smallsh_command){
+    return smallsh_command->environment != NULL ? smallsh_command->environment : exportedEnvironment(shellVariables);
+}
+
+/*
+// Launch an external command with fork() and exec().
+// The child sets up its own signal dispositions and redirection before calling execve() on path.
+// inFd and outFd are pipe ends for stdin and stdout, or -1 if the command is not piped.
+// pgid is the process group to put the child in, 0 for a new group, or -1 to stay in smallsh's group.
+// Returns the pid of the child process in the parent, or -1 and sets errno if fork() fails.
+// This function references and adapts code from Exploration: Signal Handling API, Exploration: Processes and I/O and https://brennan.io/2015/01/16/write-a-shell-in-c/.
+*/
+pid_t forkCommand(struct command* smallsh_command, char* path, int inFd, int outFd, pid_t pgid){
+    int childPid;
+    struct sigaction SIGINT_action = {0}, SIGTSTP_action = {0}, SIGPIPE_action = {0};
+    sigset_t emptyMask;
+    char** environment = commandVariables(smallsh_command);
+    int devNull = smallsh_command->background == 1 ? nullDevice() : -1;
+
+    childPid = fork();                
+    switch (childPid){
+        case -1:
+            // The fork failed, launchCommand() reports it
+            return -1;
+        case 0:
+            // Case 0 is the child process
+            if(pgid != -1){
+                setpgid(0, pgid);
+            }
+
+            // Ignore SIGTSTP whether foreground or background
+            SIGTSTP_action.sa_handler = SIG_IGN;
+            sigaction(SIGTSTP, &SIGTSTP_action, NULL);
+
+            // smallsh ignores SIGPIPE, commands get the default action
+            SIGPIPE_action.sa_handler = SIG_DFL;
+            sigaction(SIGPIPE, &SIGPIPE_action, NULL);
+
+            if(smallsh_command->background == 0){
+                // Register foreground_SIGINT as the signal handler
+                SIGINT_action.sa_handler = foreground_SIGINT;
+                // block all catchable signals while foreground_SIGINT is running.
+                sigemptyset(&SIGINT_action.sa_mask);
+                // No flags set
+                SIGINT_action.sa_flags = 0;
+                sigaction(SIGINT, &SIGINT_action, NULL);
+
+            } else if(smallsh_command->background == 1){
+                // Ignore SIGINT
+                SIGINT_action.sa_handler = SIG_IGN;
+                sigaction(SIGINT, &SIGINT_action, NULL);
+            }
+
+            // smallsh blocks the signals it reads from its signalfd, unblock them now that the dispositions are set
+            sigemptyset(&emptyMask);
+            sigprocmask(SIG_SETMASK, &emptyMask, NULL);
+
+            // Connect the pipes of a pipeline, or /dev/null for a background process with nothing else on stdin or
+            // stdout. Pipe ends and devNull are close-on-exec, dup2() clears the flag on the copies.
+            if(inFd != -1){
+                dup2(inFd, STDIN_FILENO);
+            } else if(devNull != -1 && !redirectsFd(smallsh_command, STDIN_FILENO)){
+                dup2(devNull, STDIN_FILENO);
+            }
+            if(outFd != -1){
+                dup2(outFd, STDOUT_FILENO);
+            } else if(devNull != -1 && !redirectsFd(smallsh_command, STDOUT_FILENO)){
+                dup2(devNull, STDOUT_FILENO);
+            }
+
+            // then the redirections, in the order they were given
+            if(applyRedirections(smallsh_command) == -1){
+                exit(1);
+            }
+
+            // CPU affinity, scheduling and resource limits are set last, so they do not slow down the setup above
+            if(smallsh_command->policy != NULL && applyPolicy(smallsh_command->policy) == -1){
+                exit(1);
+            }
+
+            // args is built in place by parseInput() and already ends with the NULL that execve() requires
+            execve(path, smallsh_command->args, environment);
+            if(errno == ENOENT && path != smallsh_command->args[0]){
+                // the cached path is gone, search PATH again
+                execvpe(smallsh_command->args[0], smallsh_command->args, environment);
+            }
+            perror(smallsh_command->args[0]);
+
+            // If exec returns there was an error, exit with status code 1
+            exit(1);
+            break;
+    }
+
+    // Also set the process group in the parent, so it is in place before any other stage tries to join it
+    if(pgid != -1){
+        setpgid(childPid, pgid == 0 ? childPid : pgid);
+    }
+
+    return childPid;
+}
+
+/*
+// Launch an external command with posix_spawn().
+// glibc implements posix_spawn with clone(CLONE_VM | CLONE_VFORK), so the parent's page tables are never copied.
+// Redirection is described with spawn file actions and the signal dispositions with spawn attributes:
+//  - foreground children get SIGINT reset to its default action
+//  - background children ignore SIGINT and read/write /dev/null unless redirected or piped
+//  - files are opened and here-strings are written to memory files in smallsh, and the child copies them onto its fds
+//  - every child ignores SIGTSTP and gets the default action for SIGPIPE, which smallsh ignores.
+//    posix_spawn can only reset dispositions to SIG_DFL, so children inherit SIG_IGN for SIGINT and SIGTSTP from
+//    smallsh, which ignores them for good and reads them from its signalfd, see initEvents().
+// path, inFd, outFd and pgid are the same as for forkCommand().
+// Returns the pid of the child, -1 and sets errno if the command could not be started, or -2 if one of its
+// redirections failed, which has already been reported.
+*/
+pid_t spawnCommand(struct command* smallsh_command, char* path, int inFd, int outFd, pid_t pgid){
+    pid_t childPid;
+    int err;
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t defaultMask, emptyMask;
+    int* openFds = arenaAlloc(commandArena, (smallsh_command->numRedirections + 1) * sizeof(int));
+    int numOpen;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    // Connect the pipes of a pipeline, or /dev/null for a background process with nothing else on stdin or stdout,
+    // then the redirections in the order they were given
+    if(inFd != -1){
+        posix_spawn_file_actions_adddup2(&actions, inFd, STDIN_FILENO);
+    } else if(smallsh_command->background == 1 && !redirectsFd(smallsh_command, STDIN_FILENO)){
+        posix_spawn_file_actions_adddup2(&actions, nullDevice(), STDIN_FILENO);
+    }
+    if(outFd != -1){
+        posix_spawn_file_actions_adddup2(&actions, outFd, STDOUT_FILENO);
+    } else if(smallsh_command->background == 1 && !redirectsFd(smallsh_command, STDOUT_FILENO)){
+        posix_spawn_file_actions_adddup2(&actions, nullDevice(), STDOUT_FILENO);
+    }
+    numOpen = spawnRedirections(smallsh_command, &actions, openFds);
+    if(numOpen == -1){
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attr);
+        return -2;
+    }
+
+    // Foreground processes can be interrupted with SIGINT
+    sigemptyset(&defaultMask);
+    sigaddset(&defaultMask, SIGPIPE);
+    if(smallsh_command->background == 0){
+        sigaddset(&defaultMask, SIGINT);
+    }
+    posix_spawnattr_setsigdefault(&attr, &defaultMask);
+
+    if(pgid != -1){
+        posix_spawnattr_setpgroup(&attr, pgid);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+
+    // smallsh blocks the signals it reads from its signalfd, the child starts with none blocked
+    sigemptyset(&emptyMask);
+    posix_spawnattr_setsigmask(&attr, &emptyMask);
+    posix_spawnattr_setflags(&attr, flags);
+
+    err = posix_spawn(&childPid, path, &actions, &attr, smallsh_command->args, commandVariables(smallsh_command));
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    while(numOpen > 0){
+        close(openFds[--numOpen]);
+    }
+
+    if(err != 0){
+        errno = err;
+        return -1;
+    }
+    return childPid;
+}
+
+/*
+// Start an external command using the backend selected at startup, or fork() and exec() if it has a launch policy.
+// The command is resolved through the path cache and executed directly, without searching PATH.
+// The time it takes to start the command is recorded in the stats.
+// Returns the pid of the child, or -1 if the command could not be started.
+*/
+pid_t launchCommand(struct command* smallsh_command, int inFd, int outFd, pid_t pgid){
+    pid_t childPid;
+    long long started = monotonicNs();
+    char* path = lookupCommand(commandPaths, smallsh_command->args[0]);
+
+    if(path == NULL){
+        errno = ENOENT;
+    } else if(launchMode == LAUNCH_FORK || smallsh_command->policy != NULL){
+        // posix_spawn() cannot set CPU affinity, nice values or resource limits in the child.
+        // The child cannot tell smallsh that the cached file was removed, so it is checked for before the fork.
+        if(path != smallsh_command->args[0] && access(path, X_OK) == -1){
+            forgetCommand(commandPaths, smallsh_command->args[0]);
+            path = lookupCommand(commandPaths, smallsh_command->args[0]);
+        }
+        if(path == NULL){
+            errno = ENOENT;
+        } else if((childPid = forkCommand(smallsh_command, path, inFd, outFd, pgid)) != -1){
+            statsLaunched(commandStats, childPid, smallsh_command->args[0], started, monotonicNs() - started);
+            return childPid;
+        }
+    } else {
+        childPid = spawnCommand(smallsh_command, path, inFd, outFd, pgid);
+        if(childPid == -1 && errno == ENOENT && path != smallsh_command->args[0] && access(path, X_OK) == -1){
+            // the cached file was removed, resolve the command again and retry once
+            forgetCommand(commandPaths, smallsh_command->args[0]);
+            path = lookupCommand(commandPaths, smallsh_command->args[0]);
+            if(path != NULL){
+                childPid = spawnCommand(smallsh_command, path, inFd, outFd, pgid);
+            }
+        }
+        if(childPid == -2){
+            return -1;
+        }
+        if(childPid != -1){
+            statsLaunched(commandStats, childPid, smallsh_command->args[0], started, monotonicNs() - started);
+            return childPid;
+        }
+    }
+
+    fprintf(stderr, "%s: %s\n", smallsh_command->args[0], strerror(errno));
+    fflush(stderr);
+    return -1;
+}
+
+/*
+// Launch every stage of a pipeline, connecting each stage's stdout to the next stage's stdin with a pipe.
+// A background pipeline gets its own process group so it can be signalled as one job. A foreground pipeline
+// stays in smallsh's process group, so it keeps reading from the terminal and receives SIGINT from it.
+// If relay is set, each link is made of two pipes and smallsh moves the data between them with relayPipeline().
+// The shell's ends of those pipes are stored in upstream and downstream.
+// Fills pids with the pid of each stage, -1 for a stage that could not be started. Returns the number of stages started.
+*/
+int launchPipeline(struct command* pipeline, pid_t* pids, int relay, int* upstream, int* downstream){
+    int fds[2];
+    int relayFds[2];
+    int inFd = -1;
+    int outFd;
+    int nextInFd;
+    int started = 0;
+    int i = 0;
+    pid_t pgid = pipeline->background ? 0 : -1;
+    struct command* stage;
+
+    for(stage = pipeline; stage != NULL; stage = stage->next){
+        outFd = -1;
+        nextInFd = -1;
+        if(stage->next != NULL){
+            if(pipe2(fds, O_CLOEXEC) == -1){
+                perror("pipe2()");
+                break;
+            }
+            outFd = fds[1];
+            nextInFd = fds[0];
+            if(relay){
+                if(pipe2(relayFds, O_CLOEXEC) == -1){
+                    perror("pipe2()");
+                    close(fds[0]);
+                    close(fds[1]);
+                    break;
+                }
+                upstream[i] = fds[0];
+                downstream[i] = relayFds[1];
+                nextInFd = relayFds[0];
+            }
+        }
+
+        pids[i] = launchCommand(stage, inFd, outFd, pgid);
+        if(pids[i] != -1){
+            started++;
+            if(pgid == 0){
+                // the first process started leads the pipeline's process group
+                pgid = pids[i];
+            }
+        }
+
+        // the child has its own copies of the pipe ends now
+        if(inFd != -1){
+            close(inFd);
+        }
+        if(outFd != -1){
+            close(outFd);
+        }
+        inFd = nextInFd;
+        i++;
+    }
+
+    // stages after a failed pipe2() are not started
+    for(; stage != NULL; stage = stage->next){
+        pids[i] = -1;
+        if(relay && stage->next != NULL){
+            upstream[i] = -1;
+            downstream[i] = -1;
+        }
+        i++;
+    }
+    if(inFd != -1){
+        close(inFd);
+    }
+    return started;
+}
+
+/*
+// Move data between the stages of a foreground pipeline until every stage has closed its output.
+// upstream[i] is read from stage i's stdout and downstream[i] writes to stage i + 1's stdin.
+// Data is moved with splice(), so it goes from one pipe buffer to the other without being copied through smallsh.
+// A link whose downstream pipe is full waits for it to drain instead of blocking the other links.
+*/
+void relayPipeline(int* upstream, int* downstream, int links){
+    int i;
+    int open = 0;
+    int numFds;
+    ssize_t moved;
+    struct pollfd* fds = malloc(links * sizeof(struct pollfd));
+    int* fdLink = malloc(links * sizeof(int));
+    char* waitingWrite = calloc(links, sizeof(char));
+
+    for(i = 0; i < links; i++){
+        if(upstream[i] != -1){
+            fcntl(upstream[i], F_SETFL, O_NONBLOCK);
+            fcntl(downstream[i], F_SETFL, O_NONBLOCK);
+            open++;
+        }
+    }
+
+    while(open > 0){
+        // wait for data on links that have room downstream, and for room on links that are full
+        numFds = 0;
+        for(i = 0; i < links; i++){
+            if(upstream[i] != -1){
+                fds[numFds].fd = waitingWrite[i] ? downstream[i] : upstream[i];
+                fds[numFds].events = waitingWrite[i] ? POLLOUT : POLLIN;
+                fdLink[numFds] = i;
+                numFds++;
+            }
+        }
+        if(poll(fds, numFds, -1) == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            perror("poll()");
+            break;
+        }
+
+        for(i = 0; i < numFds; i++){
+            int link = fdLink[i];
+            if(fds[i].revents == 0){
+                continue;
+            }
+            waitingWrite[link] = 0;
+            moved = splice(upstream[link], NULL, downstream[link], NULL, 1 << 16, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if(moved == -1 && errno == EAGAIN){
+                // either the upstream pipe is empty or the downstream pipe is full, wait on the downstream pipe only if it is full
+                if(fds[i].events == POLLIN && (fds[i].revents & POLLIN)){
+                    waitingWrite[link] = 1;
+                }
+                continue;
+            }
+            if(moved <= 0){
+                // the upstream stage finished writing, or the downstream stage stopped reading
+                close(upstream[link]);
+                close(downstream[link]);
+                upstream[link] = -1;
+                downstream[link] = -1;
+                open--;
+            }
+        }
+    }
+
+    for(i = 0; i < links; i++){
+        if(upstream[i] != -1){
+            close(upstream[i]);
+            close(downstream[i]);
+        }
+    }
+    free(fds);
+    free(fdLink);
+    free(waitingWrite);
+}
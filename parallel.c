@@ -0,0 +1,388 @@
+/***************************************
+ * Smallsh: the parallel builtin
+***************************************/
+#include "smallsh.h"
+#include <sys/syscall.h>
+
+#define JOB_WAITING 0
+#define JOB_RUNNING 1
+#define JOB_DONE 2
+
+/*
+// One item of a parallel run and the state of the process started for it
+*/
+struct parallelJob{
+    char* item;
+    int state;
+    pid_t pid;
+    int outFd;                  // read end of the pipe connected to the job's stdout, -1 once it is closed
+    int pidFd;                  // pidfd that becomes readable when the job exits, -1 if unavailable or reaped
+    int reaped;
+    int status;                 // wait status once reaped
+    char* output;               // everything the job wrote to stdout
+    size_t outputLen;
+    size_t outputCapacity;
+};
+
+/*
+// Read a line of smallsh's own input through the buffer of getInput(), like getline() does for a file.
+// Returns the length of the line, or -1 at the end of the input.
+*/
+static ssize_t readInputLine(char** line, size_t* len){
+    size_t used = 0;
+    int c;
+
+    while((c = readInputChar()) != EOF){
+        if(used + 2 > *len){
+            *len = *len == 0 ? 128 : *len * 2;
+            *line = realloc(*line, *len);
+        }
+        (*line)[used] = c;
+        used++;
+        if(c == '\n'){
+            break;
+        }
+    }
+    if(used == 0){
+        return -1;
+    }
+    (*line)[used] = '\0';
+    return used;
+}
+
+/*
+// Read the items of a parallel run from a file, one per line. Returns the number of items read.
+// If input is NULL they are read from smallsh's own input, which is buffered by input.c rather than by stdio.
+*/
+static int readItems(FILE* input, char*** items){
+    char* line = NULL;
+    size_t len = 0;
+    ssize_t numRead;
+    int count = 0;
+    int capacity = 64;
+
+    *items = malloc(capacity * sizeof(char*));
+    while((numRead = input != NULL ? getline(&line, &len, input) : readInputLine(&line, &len)) != -1){
+        if(numRead > 0 && line[numRead - 1] == '\n'){
+            line[numRead - 1] = '\0';
+        }
+        if(count == capacity){
+            capacity *= 2;
+            *items = realloc(*items, capacity * sizeof(char*));
+        }
+        (*items)[count] = strdup(line);
+        count++;
+    }
+    free(line);
+    return count;
+}
+
+/*
+// Replace every "{}" in arg with item. Returns a string allocated with malloc().
+*/
+static char* substituteItem(char* arg, char* item){
+    size_t itemLen = strlen(item);
+    size_t len = 0;
+    char* result;
+    char* out;
+    char* p;
+
+    for(p = arg; *p != '\0'; p++){
+        if(p[0] == '{' && p[1] == '}'){
+            len += itemLen;
+            p++;
+        } else {
+            len++;
+        }
+    }
+
+    result = malloc(len + 1);
+    out = result;
+    for(p = arg; *p != '\0'; p++){
+        if(p[0] == '{' && p[1] == '}'){
+            memcpy(out, item, itemLen);
+            out += itemLen;
+            p++;
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+    return result;
+}
+
+/*
+// Start the process for a job. The command is the template with "{}" replaced by the item,
+// or with the item appended as the last argument if the template has no "{}".
+// Returns 0 on success, -1 if the job could not be started.
+*/
+static int startJob(struct parallelJob* job, char** template, int templateArgs, int devNull){
+    int i;
+    int fds[2];
+    int substituted = 0;
+    char** args = malloc((templateArgs + 2) * sizeof(char*));
+    struct command jobCommand = {0};
+
+    for(i = 0; i < templateArgs; i++){
+        if(strstr(template[i], "{}") != NULL){
+            args[i] = substituteItem(template[i], job->item);
+            substituted = 1;
+        } else {
+            args[i] = template[i];
+        }
+    }
+    jobCommand.argc = templateArgs;
+    if(!substituted){
+        args[jobCommand.argc] = job->item;
+        jobCommand.argc++;
+    }
+    args[jobCommand.argc] = NULL;
+    jobCommand.args = args;
+
+    job->state = JOB_DONE;
+    job->status = 127 << 8;
+    if(pipe2(fds, O_CLOEXEC) == -1){
+        perror("pipe2()");
+    } else {
+        job->pid = launchCommand(&jobCommand, devNull, fds[1], -1);
+        close(fds[1]);
+        if(job->pid == -1){
+            close(fds[0]);
+        } else {
+            job->state = JOB_RUNNING;
+            job->outFd = fds[0];
+            job->pidFd = syscall(SYS_pidfd_open, job->pid, 0);
+            job->reaped = 0;
+        }
+    }
+
+    for(i = 0; i < templateArgs; i++){
+        if(args[i] != template[i]){
+            free(args[i]);
+        }
+    }
+    free(args);
+    return job->state == JOB_RUNNING ? 0 : -1;
+}
+
+/*
+// Reap a job's process and record its resource usage. Blocks unless the process is known to have exited.
+*/
+static void reapParallelJob(struct parallelJob* job, int options){
+    struct rusage usage;
+
+    if(wait4(job->pid, &job->status, options, &usage) == job->pid){
+        statsReaped(commandStats, job->pid, job->status, &usage);
+        job->reaped = 1;
+        if(job->pidFd != -1){
+            close(job->pidFd);
+            job->pidFd = -1;
+        }
+    }
+}
+
+/*
+// Read what is available from a job's stdout into its output buffer, closing the pipe at end of file
+*/
+static void readJobOutput(struct parallelJob* job){
+    ssize_t numRead;
+
+    if(job->outputCapacity - job->outputLen < (1 << 16)){
+        job->outputCapacity = job->outputCapacity * 2 + (1 << 16);
+        job->output = realloc(job->output, job->outputCapacity);
+    }
+    numRead = read(job->outFd, job->output + job->outputLen, job->outputCapacity - job->outputLen);
+    if(numRead > 0){
+        job->outputLen += numRead;
+    } else if(numRead == 0 || errno != EINTR){
+        close(job->outFd);
+        job->outFd = -1;
+    }
+}
+
+/*
+// Print a finished job's output, with each line prefixed by the item and a tab if tag is set
+*/
+static void printJobOutput(struct parallelJob* job, int tag){
+    size_t start = 0;
+    char* newline;
+
+    if(!tag){
+        fwrite(job->output, 1, job->outputLen, stdout);
+    } else {
+        while(start < job->outputLen){
+            newline = memchr(job->output + start, '\n', job->outputLen - start);
+            size_t end = newline != NULL ? (size_t)(newline - job->output) + 1 : job->outputLen;
+            printf("%s\t", job->item);
+            fwrite(job->output + start, 1, end - start, stdout);
+            start = end;
+        }
+    }
+    fflush(stdout);
+    free(job->output);
+    job->output = NULL;
+}
+
+/*
+// Run a command once for each item with at most N processes at a time.
+// Usage: parallel [-j N] [-t] command [args...] [::: items...]
+// Without ":::" the items are the lines of stdin, or of the file given with '<'.
+// "{}" in the command is replaced by the item, otherwise the item is added as the last argument.
+// As soon as a job finishes the next item is started. The output of each job is collected and printed
+// in the order of the items, prefixed with the item and a tab if -t is given.
+// N defaults to the number of online CPUs. exitStatus is set to the number of failed jobs, at most 101.
+*/
+void smallsh_parallel(struct command* smallsh_command){
+    int i;
+    int maxJobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int tag = 0;
+    int templateStart;
+    int templateArgs;
+    int numItems;
+    int next = 0;
+    int printed = 0;
+    int running = 0;
+    int failures = 0;
+    int numFds;
+    int devNull = nullDevice();
+    char** args = smallsh_command->args;
+    char** items;
+    int ownItems = 0;
+    struct parallelJob* jobs;
+    struct pollfd* fds;
+    int* fdJob;
+
+    // options
+    for(i = 1; args[i] != NULL && args[i][0] == '-'; i++){
+        if(strcmp(args[i], "-j") == 0 && args[i + 1] != NULL){
+            maxJobs = atoi(args[i + 1]);
+            i++;
+        } else if(strcmp(args[i], "-t") == 0){
+            tag = 1;
+        } else {
+            break;
+        }
+    }
+    templateStart = i;
+    for(templateArgs = 0; args[templateStart + templateArgs] != NULL && strcmp(args[templateStart + templateArgs], ":::") != 0; templateArgs++);
+    if(templateArgs == 0 || maxJobs < 1){
+        fprintf(stderr, "usage: parallel [-j N] [-t] command [args...] [::: items...]\n");
+        fflush(stderr);
+        exitStatus = 1;
+        return;
+    }
+
+    // items come after ":::", or from the input file or stdin
+    if(args[templateStart + templateArgs] != NULL){
+        items = args + templateStart + templateArgs + 1;
+        for(numItems = 0; items[numItems] != NULL; numItems++);
+    } else {
+        // stdin is smallsh's own input unless it is redirected or commands come from a script
+        FILE* input = batch != NULL || redirectsFd(smallsh_command, STDIN_FILENO) ? stdin : NULL;
+        if(inputFile(smallsh_command) != NULL){
+            input = fopen(inputFile(smallsh_command), "re");
+            if(input == NULL){
+                perror(inputFile(smallsh_command));
+                exitStatus = 1;
+                return;
+            }
+        }
+        numItems = readItems(input, &items);
+        ownItems = 1;
+        if(input != NULL && input != stdin){
+            fclose(input);
+        }
+    }
+
+    jobs = calloc(numItems > 0 ? numItems : 1, sizeof(struct parallelJob));
+    fds = malloc(2 * maxJobs * sizeof(struct pollfd));
+    fdJob = malloc(2 * maxJobs * sizeof(int));
+    for(i = 0; i < numItems; i++){
+        jobs[i].item = items[i];
+        jobs[i].outFd = -1;
+        jobs[i].pidFd = -1;
+    }
+
+    while(printed < numItems){
+        // keep maxJobs processes running
+        while(running < maxJobs && next < numItems){
+            if(startJob(&jobs[next], args + templateStart, templateArgs, devNull) == 0){
+                running++;
+            } else {
+                failures++;
+            }
+            next++;
+        }
+
+        // print finished jobs in the order of their items
+        while(printed < numItems && jobs[printed].state == JOB_DONE){
+            printJobOutput(&jobs[printed], tag);
+            printed++;
+        }
+        if(running == 0){
+            continue;
+        }
+
+        // wait for output or for a job to exit
+        numFds = 0;
+        for(i = printed; i < next; i++){
+            if(jobs[i].state != JOB_RUNNING){
+                continue;
+            }
+            if(jobs[i].outFd != -1){
+                fds[numFds].fd = jobs[i].outFd;
+                fds[numFds].events = POLLIN;
+                fdJob[numFds++] = i;
+            }
+            if(jobs[i].pidFd != -1){
+                fds[numFds].fd = jobs[i].pidFd;
+                fds[numFds].events = POLLIN;
+                fdJob[numFds++] = i;
+            }
+        }
+        if(numFds > 0 && poll(fds, numFds, -1) == -1 && errno != EINTR){
+            perror("poll()");
+            break;
+        }
+
+        for(i = 0; i < numFds; i++){
+            struct parallelJob* job = &jobs[fdJob[i]];
+            if(fds[i].revents == 0){
+                continue;
+            }
+            if(fds[i].fd == job->outFd){
+                readJobOutput(job);
+            } else if(fds[i].fd == job->pidFd){
+                reapParallelJob(job, WNOHANG);
+            }
+        }
+
+        // a job is finished once its output is closed and its process is reaped
+        for(i = printed; i < next; i++){
+            if(jobs[i].state == JOB_RUNNING && jobs[i].outFd == -1){
+                if(!jobs[i].reaped && jobs[i].pidFd == -1){
+                    // no pidfd, the process has closed its output so it is about to exit
+                    reapParallelJob(&jobs[i], 0);
+                }
+                if(jobs[i].reaped){
+                    jobs[i].state = JOB_DONE;
+                    running--;
+                    if(jobs[i].status != 0){
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+
+    if(ownItems){
+        for(i = 0; i < numItems; i++){
+            free(items[i]);
+        }
+        free(items);
+    }
+    free(jobs);
+    free(fds);
+    free(fdJob);
+    exitStatus = failures > 101 ? 101 : failures;
+}
@@ -0,0 +1,889 @@
+/***************************************
+ * Smallsh: variable expansion and command parsing
+***************************************/
+#include "smallsh.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define PARSE_WORD 0                // a field of a word, the argument of a command or the file of a redirection
+#define PARSE_REDIRECT 1            // a redirection operator, offset is its index in the tokenizer's redirections
+#define PARSE_PIPE 2                // |
+#define PARSE_ASSIGNMENT 3          // a NAME=value word before the command name
+
+/*
+// Allocate a command from the arena and initialize all of its members.
+// maxArgs is the most arguments the command can hold; args always has room for the NULL that ends it.
+*/
+struct command* initCommand(struct arena* arena, int maxArgs){
+    struct command *smallsh_command = arenaAlloc(arena, sizeof(struct command));
+
+    smallsh_command->args = arenaAlloc(arena, (maxArgs + 1) * sizeof(char*));
+    memset(smallsh_command->args, 0, (maxArgs + 1) * sizeof(char*));
+    smallsh_command->argc = 0;
+    smallsh_command->redirections = NULL;
+    smallsh_command->numRedirections = 0;
+    smallsh_command->background = 0;
+    smallsh_command->assignments = smallsh_command->args;
+    smallsh_command->numAssignments = 0;
+    smallsh_command->environment = NULL;
+    smallsh_command->substituted = 0;
+    smallsh_command->next = NULL;
+
+    return smallsh_command;
+}
+
+/*
+// Output buffer for the words of the tokenizer. It grows inside the arena as text is appended.
+*/
+struct expansion{
+    struct arena* arena;
+    char* data;
+    size_t len;
+    size_t capacity;
+};
+
+/*
+// Append len bytes of text to an expansion, growing it to at least twice its size when it is full
+*/
+static void appendExpansion(struct expansion* out, const char* text, size_t len){
+    if(out->len + len + 1 > out->capacity){
+        size_t capacity = out->capacity * 2;
+        if(capacity < out->len + len + 1){
+            capacity = out->len + len + 1;
+        }
+        out->data = arenaGrow(out->arena, out->data, out->capacity, capacity);
+        out->capacity = capacity;
+    }
+    memcpy(out->data + out->len, text, len);
+    out->len += len;
+}
+
+/*
+// Find the value of the variable whose name starts at text, just after a '$'.
+//  $$              the pid of smallsh
+//  $?              the exit code of the last foreground command
+//  $!              the pid of the last background process
+//  $0 ... $9       the positional parameters, the script and its arguments or the arguments of a function
+//  $#              the number of positional parameters after $0
+//  $@, $*          the positional parameters after $0, separated by spaces
+//  $VAR, ${VAR}    the value of the shell variable VAR, or nothing if it is not set
+// Sets *after to the first character after the name. Returns NULL if the '$' does not start one of these.
+// number is a buffer of 16 bytes for values that have to be formatted. text must be writable, names are
+// terminated in place while they are looked up.
+*/
+static char* lookupVariable(struct arena* arena, char* text, char* end, char** after, char* number){
+    static char pidString[16] = "";
+    char* name;
+    char* value;
+    char saved;
+
+    *after = text + 1;
+    if(text >= end){
+        return NULL;
+    }
+
+    switch(*text){
+        case '$':
+            // the pid of smallsh never changes, so it is only formatted once
+            if(pidString[0] == '\0'){
+                snprintf(pidString, sizeof(pidString), "%d", getpid());
+            }
+            return pidString;
+        case '?':
+            snprintf(number, 16, "%d", exitStatus);
+            return number;
+        case '!':
+            number[0] = '\0';
+            if(lastBackgroundPid != 0){
+                snprintf(number, 16, "%d", lastBackgroundPid);
+            }
+            return number;
+        case '#':
+            snprintf(number, 16, "%d", positionalCount);
+            return number;
+        case '@':
+        case '*':
+            {
+                struct expansion joined = {arena, arenaAlloc(arena, 64), 0, 64};
+                int position;
+                for(position = 1; position <= positionalCount; position++){
+                    appendExpansion(&joined, positionalArgs[position], strlen(positionalArgs[position]));
+                    if(position < positionalCount){
+                        appendExpansion(&joined, " ", 1);
+                    }
+                }
+                joined.data[joined.len] = '\0';
+                return joined.data;
+            }
+    }
+
+    if(isdigit((unsigned char)*text)){
+        int position = *text - '0';
+        return position <= positionalCount ? positionalArgs[position] : "";
+    }
+
+    if(*text == '_' || isalpha((unsigned char)*text)){
+        name = text;
+        while(text < end && (*text == '_' || isalnum((unsigned char)*text))){
+            text++;
+        }
+        *after = text;
+        saved = *text;
+        *text = '\0';
+        value = getVariable(shellVariables, name);
+        *text = saved;
+        return value != NULL ? value : "";
+    }
+
+    if(*text == '{'){
+        char* close = memchr(text, '}', end - text);
+        if(close == NULL){
+            return NULL;
+        }
+        name = text + 1;
+        *close = '\0';
+        if(isdigit((unsigned char)name[0])){
+            // ${10} and above reach the positional parameters that $N cannot
+            int position = atoi(name);
+            value = position <= positionalCount ? positionalArgs[position] : "";
+        } else {
+            value = getVariable(shellVariables, name);
+        }
+        *close = '}';
+        *after = close + 1;
+        return value != NULL ? value : "";
+    }
+    return NULL;
+}
+
+/*
+// Bytes that end a plain run of characters inside a word
+*/
+static const char specialChars[] = " \t'\"\\$<>|&`*?[";
+
+/*
+// Find the first byte from text up to end that is one of specialChars, or end if there is none.
+// With SSE2 16 bytes are compared against every special character at once.
+*/
+static char* findSpecial(char* text, char* end){
+    static unsigned char isSpecial[256];
+    int i;
+
+    if(!isSpecial[' ']){
+        for(i = 0; specialChars[i] != '\0'; i++){
+            isSpecial[(unsigned char)specialChars[i]] = 1;
+        }
+    }
+
+#ifdef __SSE2__
+    while(end - text >= 16){
+        __m128i chunk = _mm_loadu_si128((const __m128i*)text);
+        __m128i hits = _mm_setzero_si128();
+        int mask;
+        for(i = 0; specialChars[i] != '\0'; i++){
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(specialChars[i])));
+        }
+        mask = _mm_movemask_epi8(hits);
+        if(mask != 0){
+            return text + __builtin_ctz(mask);
+        }
+        text += 16;
+    }
+#endif
+    while(text < end && !isSpecial[(unsigned char)*text]){
+        text++;
+    }
+    return text;
+}
+
+/*
+// Find the ')' that closes a $( whose text starts at text, skipping quotes, escapes and nested parentheses.
+// Returns end if it is not closed.
+*/
+static char* substitutionEnd(char* text, char* end){
+    int depth = 1;
+
+    while(text < end){
+        switch(*text){
+            case '\\':
+                text++;
+                break;
+            case '\'':
+                text = memchr(text + 1, '\'', end - text - 1);
+                if(text == NULL){
+                    return end;
+                }
+                break;
+            case '"':
+                for(text++; text < end && *text != '"'; text++){
+                    if(*text == '\\'){
+                        text++;
+                    }
+                }
+                break;
+            case '(':
+                depth++;
+                break;
+            case ')':
+                depth--;
+                if(depth == 0){
+                    return text;
+                }
+                break;
+        }
+        if(text >= end){
+            return end;
+        }
+        text++;
+    }
+    return end;
+}
+
+/*
+// Find the '`' that closes a `...` substitution whose text starts at text, or end if it is not closed
+*/
+static char* backquoteEnd(char* text, char* end){
+    while(text < end && *text != '`'){
+        text += *text == '\\' ? 2 : 1;
+    }
+    return text < end ? text : end;
+}
+
+/*
+// Return the end of the word that starts at text: the first blank, ';' or '\0' that is not quoted or escaped.
+// An unterminated quote runs to the end of the text. The script parser uses this to find where commands end.
+*/
+char* wordEnd(char* text){
+    while(1){
+        text += strcspn(text, " \t;'\"\\$`");
+        switch(*text){
+            case '\'':
+                {
+                    char* close = strchr(text + 1, '\'');
+                    text = close != NULL ? close + 1 : text + strlen(text);
+                }
+                break;
+            case '"':
+                text++;
+                while(*text != '\0' && *text != '"'){
+                    if(text[0] == '$' && text[1] == '('){
+                        text = substitutionEnd(text + 2, text + strlen(text));
+                    }
+                    if(*text != '\0'){
+                        text += text[0] == '\\' && text[1] != '\0' ? 2 : 1;
+                    }
+                }
+                if(*text == '"'){
+                    text++;
+                }
+                break;
+            case '\\':
+                text += text[1] != '\0' ? 2 : 1;
+                break;
+            case '$':
+                // a $(...) substitution is part of the word, blanks and ';' inside it included
+                if(text[1] == '('){
+                    text = substitutionEnd(text + 2, text + strlen(text));
+                    if(*text == ')'){
+                        text++;
+                    }
+                } else {
+                    text++;
+                }
+                break;
+            case '`':
+                text = backquoteEnd(text + 1, text + strlen(text));
+                if(*text == '`'){
+                    text++;
+                }
+                break;
+            default:
+                return text;
+        }
+    }
+}
+
+/*
+// A word or operator found by the tokenizer.
+// A word that needed no quote removal or expansion points into the input, otherwise it is at offset in the
+// tokenizer's text, which may still move while the line is being tokenized.
+*/
+struct token{
+    int type;                   // one of the PARSE_ constants
+    char* text;
+    size_t offset;
+};
+
+/*
+// State of parseInput() while it splits a line into tokens
+*/
+struct tokenizer{
+    struct arena* arena;
+    struct token* tokens;
+    int numTokens;
+    int capacity;
+    struct expansion text;      // the words that could not be used in place, each ending with '\0'
+    int fieldOpen;              // 1 while a word is being built at the end of text
+    size_t fieldStart;
+    int assignments;            // 1 until the first word of the stage that is not a NAME=value assignment
+    int target;                 // 1 after a redirection operator, until the word that follows it
+    int substituted;            // 1 once a command substitution has run
+    int noGlob;                 // 1 for a word that is not expanded into file names, an assignment or redirection
+    int fieldGlob;              // 1 if the word being built has an unquoted *, ? or [
+    int fieldEscaped;           // 1 if backslashes were added to the word being built, see appendPart()
+    struct globCache* globs;    // directory listings read for the line's patterns, allocated by the first one
+    struct redirection* redirections;   // the redirection operators, completed with their words by parseInput()
+    int numRedirections;
+    int redirectionCapacity;
+    char number[16];
+};
+
+static void addToken(struct tokenizer* tokenizer, int type, char* text, size_t offset){
+    if(tokenizer->numTokens == tokenizer->capacity){
+        tokenizer->tokens = arenaGrow(tokenizer->arena, tokenizer->tokens, tokenizer->capacity * sizeof(struct token),
+                                      tokenizer->capacity * 2 * sizeof(struct token));
+        tokenizer->capacity *= 2;
+    }
+    tokenizer->tokens[tokenizer->numTokens].type = type;
+    tokenizer->tokens[tokenizer->numTokens].text = text;
+    tokenizer->tokens[tokenizer->numTokens].offset = offset;
+    tokenizer->numTokens++;
+}
+
+/*
+// Start a word in the tokenizer's text, unless one is already being built.
+// A word exists once it is started, so "" is an empty argument while an unset $VAR is no argument at all.
+*/
+static void startField(struct tokenizer* tokenizer){
+    if(!tokenizer->fieldOpen){
+        tokenizer->fieldOpen = 1;
+        tokenizer->fieldStart = tokenizer->text.len;
+        tokenizer->fieldGlob = 0;
+        tokenizer->fieldEscaped = 0;
+    }
+}
+
+/*
+// Remove the backslashes appendPart() added to text, in place. Returns the new length of text.
+*/
+static size_t removeEscapes(char* text){
+    char* to = text;
+    char* from;
+
+    for(from = text; *from != '\0'; from++){
+        if(*from == '\\' && from[1] != '\0'){
+            from++;
+        }
+        *to++ = *from;
+    }
+    *to = '\0';
+    return to - text;
+}
+
+/*
+// End the word being built. A word with an unquoted *, ? or [ is replaced by the file names that match it, in
+// order, or is kept as it is if nothing matches.
+*/
+static void endField(struct tokenizer* tokenizer){
+    char** matches;
+    int numMatches;
+    int i;
+
+    if(!tokenizer->fieldOpen){
+        return;
+    }
+    appendExpansion(&tokenizer->text, "", 1);
+    tokenizer->fieldOpen = 0;
+
+    if(tokenizer->fieldGlob){
+        if(tokenizer->globs == NULL){
+            tokenizer->globs = initGlobCache(tokenizer->arena);
+        }
+        numMatches = expandGlob(tokenizer->globs, tokenizer->text.data + tokenizer->fieldStart, &matches);
+        if(numMatches > 0){
+            // the pattern is no longer needed, the matches are in the arena or in the cached listings
+            tokenizer->text.len = tokenizer->fieldStart;
+            for(i = 0; i < numMatches; i++){
+                addToken(tokenizer, PARSE_WORD, matches[i], 0);
+            }
+            return;
+        }
+    }
+    if(tokenizer->fieldGlob || tokenizer->fieldEscaped){
+        tokenizer->text.len = tokenizer->fieldStart + removeEscapes(tokenizer->text.data + tokenizer->fieldStart) + 1;
+    }
+    addToken(tokenizer, PARSE_WORD, NULL, tokenizer->fieldStart);
+}
+
+static void appendField(struct tokenizer* tokenizer, const char* text, size_t len){
+    startField(tokenizer);
+    appendExpansion(&tokenizer->text, text, len);
+}
+
+/*
+// Append text that may contain pattern characters to the word being built.
+// Unquoted, a *, ? or [ makes the word a pattern. Quoted ones, and every backslash, are escaped so that they only
+// match themselves; endField() removes the escapes again if the word is not expanded.
+*/
+static void appendPart(struct tokenizer* tokenizer, const char* text, size_t len, int quoted){
+    size_t start = 0;
+    size_t i;
+
+    if(tokenizer->noGlob){
+        appendField(tokenizer, text, len);
+        return;
+    }
+    startField(tokenizer);
+    for(i = 0; i < len; i++){
+        if(text[i] != '\\' && text[i] != '*' && text[i] != '?' && text[i] != '['){
+            continue;
+        }
+        if(!quoted && text[i] != '\\'){
+            tokenizer->fieldGlob = 1;
+            continue;
+        }
+        appendExpansion(&tokenizer->text, text + start, i - start);
+        appendExpansion(&tokenizer->text, "\\", 1);
+        tokenizer->fieldEscaped = 1;
+        start = i;
+    }
+    appendExpansion(&tokenizer->text, text + start, len - start);
+}
+
+/*
+// Return 1 if the len bytes at text have a *, ? or [
+*/
+static int hasPattern(const char* text, size_t len){
+    size_t i;
+
+    for(i = 0; i < len; i++){
+        if(text[i] == '*' || text[i] == '?' || text[i] == '['){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+// Append the value of a variable to the word being built.
+// Outside of double quotes the value is split into separate words at blanks.
+*/
+static void appendValue(struct tokenizer* tokenizer, char* value, int quoted){
+    size_t len;
+
+    if(quoted){
+        appendPart(tokenizer, value, strlen(value), 1);
+        return;
+    }
+    while(*value != '\0'){
+        len = strcspn(value, " \t\n");
+        if(len > 0){
+            appendPart(tokenizer, value, len, 0);
+            value += len;
+        }
+        if(*value != '\0'){
+            endField(tokenizer);
+            value += strspn(value, " \t\n");
+        }
+    }
+}
+
+/*
+// Return 1 if there is nothing but blanks from text up to end
+*/
+static int onlyBlanks(char* text, char* end){
+    while(text < end && (*text == ' ' || *text == '\t')){
+        text++;
+    }
+    return text == end;
+}
+
+/*
+// Add the output of a command substitution to the word being built.
+// Outside of double quotes the output is split into words at blanks and newlines in place: every word that is
+// not joined to text before or after the substitution, and is not a pattern, is used where it is, without being copied.
+// wordEnds is 1 if nothing follows the substitution in its word.
+*/
+static void appendOutput(struct tokenizer* tokenizer, char* output, size_t len, int quoted, int wordEnds){
+    char* end = output + len;
+    char* field;
+
+    if(quoted){
+        appendPart(tokenizer, output, len, 1);
+        return;
+    }
+    while(output < end){
+        for(field = output; output < end && *output != ' ' && *output != '\t' && *output != '\n'; output++);
+        if(output > field){
+            if(tokenizer->fieldOpen || (output == end && !wordEnds)
+               || (!tokenizer->noGlob && hasPattern(field, output - field))){
+                appendPart(tokenizer, field, output - field, 0);
+            } else {
+                *output = '\0';
+                addToken(tokenizer, PARSE_WORD, field, 0);
+            }
+        }
+        if(output < end){
+            endField(tokenizer);
+            output++;
+        }
+    }
+}
+
+/*
+// Run the command substitution whose text runs from text up to stop and add its output to the word being built.
+// after is the first character after the substitution. Returns after.
+*/
+static char* substitute(struct tokenizer* tokenizer, char* text, char* stop, char* after, char* end, int quoted){
+    size_t len;
+    char* output = commandOutput(tokenizer->arena, text, stop - text, &len);
+    tokenizer->substituted = 1;
+    int wordEnds = after >= end || strchr(" \t<>|", *after) != NULL || (*after == '&' && onlyBlanks(after + 1, end));
+
+    appendOutput(tokenizer, output, len, quoted, wordEnds);
+    return after;
+}
+
+/*
+// Run the `...` substitution at the '`' at text. Within it a backslash only escapes $, ` and \, those backslashes
+// are removed in place before the commands run. Returns the first character after it.
+*/
+static char* substituteBackquoted(struct tokenizer* tokenizer, char* text, char* end, int quoted){
+    char* close = backquoteEnd(text + 1, end);
+    char* from;
+    char* to = text + 1;
+
+    for(from = text + 1; from < close; from++){
+        if(*from == '\\' && from + 1 < close && strchr("$`\\", from[1]) != NULL){
+            from++;
+        }
+        *to++ = *from;
+    }
+    return substitute(tokenizer, text + 1, to, close < end ? close + 1 : end, end, quoted);
+}
+
+/*
+// Expand the variable or $(...) command substitution at the '$' at text. Returns the first character after it.
+*/
+static char* expandDollar(struct tokenizer* tokenizer, char* text, char* end, int quoted){
+    char* after;
+    char* value;
+    char* close;
+
+    if(text + 1 < end && text[1] == '('){
+        close = substitutionEnd(text + 2, end);
+        return substitute(tokenizer, text + 2, close, close < end ? close + 1 : end, end, quoted);
+    }
+
+    value = lookupVariable(tokenizer->arena, text + 1, end, &after, tokenizer->number);
+
+    if(value == NULL){
+        appendField(tokenizer, "$", 1);
+        return text + 1;
+    }
+    appendValue(tokenizer, value, quoted);
+    return after;
+}
+
+/*
+// Add the part of a word between double quotes, starting after the opening quote, to the word being built.
+// Variables and command substitutions are expanded but not split, and a backslash only escapes $, ", \ and `.
+// Returns the first character after the closing quote.
+*/
+static char* lexDoubleQuoted(struct tokenizer* tokenizer, char* text, char* end){
+    char* stop;
+
+    startField(tokenizer);
+    while(text < end && *text != '"'){
+        for(stop = text; stop < end && *stop != '"' && *stop != '\\' && *stop != '$' && *stop != '`'; stop++);
+        appendPart(tokenizer, text, stop - text, 1);
+        text = stop;
+        if(text < end && *text == '\\'){
+            if(text + 1 < end && strchr("$\"\\`", text[1]) != NULL){
+                text++;
+            }
+            appendPart(tokenizer, text, 1, 1);
+            text++;
+        } else if(text < end && *text == '$'){
+            text = expandDollar(tokenizer, text, end, 1);
+        } else if(text < end && *text == '`'){
+            text = substituteBackquoted(tokenizer, text, end, 1);
+        }
+    }
+    return text < end ? text + 1 : end;
+}
+
+/*
+// Split the word that starts at text into the tokenizer, removing quotes and escapes and expanding variables.
+// A word without any of those is terminated in place and used without copying.
+// NAME=value words before the command name are assignments, which are never split, nor is the word of a redirection.
+// Any other word with an unquoted *, ? or [ is replaced by the file names that match it, see glob.c.
+// Sets *background if the word is ended by a '&' that is the last thing on the line.
+// Returns the first character after the word.
+*/
+static char* lexWord(struct tokenizer* tokenizer, char* text, char* end, int* background){
+    char* special = findSpecial(text, end);
+    char* close;
+    int target = tokenizer->target;
+    size_t nameLen = tokenizer->assignments && !target ? variableNameLen(text) : 0;
+    int assignment = nameLen > 0 && text + nameLen < end && text[nameLen] == '=';
+    int type = assignment ? PARSE_ASSIGNMENT : PARSE_WORD;
+    int whole = assignment || target;
+
+    tokenizer->noGlob = whole;
+
+    // the word after a redirection operator does not end the assignments before the command name
+    if(!target){
+        tokenizer->assignments = assignment;
+    }
+    tokenizer->target = 0;
+
+    // fast path, a plain word ended by a blank or the end of the line
+    if(special == end || *special == ' ' || *special == '\t'){
+        *special = '\0';
+        addToken(tokenizer, type, text, 0);
+        return special == end ? end : special + 1;
+    }
+
+    while(text < end){
+        special = findSpecial(text, end);
+        if(special > text){
+            appendField(tokenizer, text, special - text);
+        }
+        text = special;
+        if(text == end){
+            break;
+        }
+
+        if(*text == ' ' || *text == '\t' || *text == '<' || *text == '>' || *text == '|'){
+            break;
+        } else if(*text == '&'){
+            if(onlyBlanks(text + 1, end)){
+                *background = 1;
+                text = end;
+                break;
+            }
+            appendField(tokenizer, text, 1);
+            text++;
+        } else if(*text == '*' || *text == '?' || *text == '['){
+            appendPart(tokenizer, text, 1, 0);
+            text++;
+        } else if(*text == '\\'){
+            // a backslash keeps the next character as it is, one at the end of the line is dropped
+            if(text + 1 < end){
+                appendPart(tokenizer, text + 1, 1, 1);
+            }
+            text += 2;
+        } else if(*text == '\''){
+            // nothing is special between single quotes
+            close = memchr(text + 1, '\'', end - text - 1);
+            if(close == NULL){
+                close = end;
+            }
+            appendPart(tokenizer, text + 1, close - text - 1, 1);
+            text = close < end ? close + 1 : end;
+        } else if(*text == '"'){
+            text = lexDoubleQuoted(tokenizer, text + 1, end);
+        } else if(*text == '`'){
+            text = substituteBackquoted(tokenizer, text, end, whole);
+        } else {
+            text = expandDollar(tokenizer, text, end, whole);
+        }
+    }
+    endField(tokenizer);
+    if(assignment){
+        tokenizer->tokens[tokenizer->numTokens - 1].type = PARSE_ASSIGNMENT;
+    }
+    return text < end ? text : end;
+}
+
+/*
+// Add the redirection operator at text to the tokenizer, with the fd number that text starts with if any:
+//  [n]<  [n]>  [n]>>  [n]<<<  [n]<&  [n]>&
+// Its file, text or fd is the next word. Returns the first character after the operator.
+*/
+static char* lexRedirection(struct tokenizer* tokenizer, char* text){
+    struct redirection* redirection;
+
+    if(tokenizer->numRedirections == tokenizer->redirectionCapacity){
+        tokenizer->redirections = arenaGrow(tokenizer->arena, tokenizer->redirections,
+                                            tokenizer->redirectionCapacity * sizeof(struct redirection),
+                                            tokenizer->redirectionCapacity * 2 * sizeof(struct redirection));
+        tokenizer->redirectionCapacity *= 2;
+    }
+    redirection = &tokenizer->redirections[tokenizer->numRedirections];
+    addToken(tokenizer, PARSE_REDIRECT, NULL, tokenizer->numRedirections);
+    tokenizer->numRedirections++;
+    tokenizer->target = 1;
+
+    redirection->type = REDIRECT_OPEN;
+    redirection->fd = isdigit((unsigned char)*text) ? (int)strtol(text, &text, 10) : (*text == '<' ? 0 : 1);
+    redirection->source = -1;
+    redirection->text = NULL;
+    if(text[1] == '&'){
+        redirection->type = REDIRECT_DUP;
+        return text + 2;
+    }
+    if(*text == '<'){
+        if(text[1] == '<' && text[2] == '<'){
+            redirection->type = REDIRECT_STRING;
+            return text + 3;
+        }
+        redirection->flags = O_RDONLY;
+        return text + 1;
+    }
+    if(text[1] == '>'){
+        redirection->flags = O_WRONLY | O_CREAT | O_APPEND;
+        return text + 2;
+    }
+    redirection->flags = O_WRONLY | O_CREAT | O_TRUNC;
+    return text + 1;
+}
+
+/*
+// Parse the user's input.
+// The input should consists of a command followed by arguments, separated by spaces or tabs.
+// input can contain redirections, see lexRedirection(). The word after a redirection operator is its file,
+// text or fd. Redirections are compiled into each stage's plan and applied in the order they are given.
+// If the last character is '&' the process will be run in the background.
+// '|' separates the stages of a pipeline, each of which can have its own redirection.
+// Single quotes, double quotes and backslashes work as they do in sh. Variables and $(...) and `...` command
+// substitutions are expanded as each word is read, and outside of double quotes their values are split into words.
+// Unquoted *, ? and [ in a word expand it into the file names it matches.
+// Lines and argument lists can be any length. Words are views into input wherever possible, so input must stay
+// valid while the command is used.
+// If input is blank or begins with #, it is treated as a comment.
+// A redirection operator without a word is a syntax error, which is reported and sets the exit status to 2.
+// The line is then skipped like a comment.
+*/
+struct command* parseInput(struct arena* arena, char* input){
+    struct tokenizer tokenizer;
+    struct command* smallsh_command;
+    struct command* stage;
+    size_t len = strlen(input);
+    char* end;
+    char* text;
+    char** args;
+    int background = 0;
+    int numWords = 0;
+    int numStages = 1;
+    int argc = 0;
+    int numRedirections = 0;
+    struct redirection* plan;
+    char* digits;
+    int i;
+
+    // remove the '\n' from the end of the input. The words below point into the input, or into the tokenizer's text.
+    if(len > 0 && input[len - 1] == '\n'){
+        len--;
+        input[len] = '\0';
+    }
+    end = input + len;
+
+    // If the first word starts with "#" or the line is blank then return
+    text = input + strspn(input, " \t");
+    if(*text == '#' || *text == '\0'){
+        return initCommand(arena, 0);
+    }
+
+    tokenizer.arena = arena;
+    tokenizer.capacity = 16;
+    tokenizer.numTokens = 0;
+    tokenizer.tokens = arenaAlloc(arena, tokenizer.capacity * sizeof(struct token));
+    tokenizer.text.arena = arena;
+    tokenizer.text.capacity = 64;
+    tokenizer.text.len = 0;
+    tokenizer.text.data = arenaAlloc(arena, tokenizer.text.capacity);
+    tokenizer.fieldOpen = 0;
+    tokenizer.assignments = 1;
+    tokenizer.target = 0;
+    tokenizer.substituted = 0;
+    tokenizer.noGlob = 0;
+    tokenizer.fieldGlob = 0;
+    tokenizer.fieldEscaped = 0;
+    tokenizer.globs = NULL;
+    tokenizer.redirectionCapacity = 4;
+    tokenizer.numRedirections = 0;
+    tokenizer.redirections = arenaAlloc(arena, tokenizer.redirectionCapacity * sizeof(struct redirection));
+
+    while(text < end){
+        // digits just before < or > are the fd of the redirection, unless they are the word of another one
+        for(digits = text; !tokenizer.target && isdigit((unsigned char)*digits); digits++);
+        if(*text == ' ' || *text == '\t'){
+            text++;
+        } else if(*digits == '<' || *digits == '>'){
+            text = lexRedirection(&tokenizer, text);
+        } else if(*text == '|'){
+            addToken(&tokenizer, PARSE_PIPE, NULL, 0);
+            tokenizer.assignments = 1;
+            text++;
+        } else {
+            text = lexWord(&tokenizer, text, end, &background);
+        }
+    }
+
+    // count the words and stages, so that args can be allocated once for the whole pipeline
+    for(i = 0; i < tokenizer.numTokens; i++){
+        if(tokenizer.tokens[i].type == PARSE_WORD || tokenizer.tokens[i].type == PARSE_ASSIGNMENT){
+            numWords++;
+            if(tokenizer.tokens[i].text == NULL){
+                tokenizer.tokens[i].text = tokenizer.text.data + tokenizer.tokens[i].offset;
+            }
+        } else if(tokenizer.tokens[i].type == PARSE_PIPE){
+            numStages++;
+        } else if(i + 1 == tokenizer.numTokens || tokenizer.tokens[i + 1].type != PARSE_WORD){
+            fprintf(stderr, "smallsh: syntax error near unexpected %s\n",
+                    i + 1 == tokenizer.numTokens ? "newline" : tokenizer.tokens[i + 1].type == PARSE_PIPE ? "'|'" : "redirection");
+            fflush(stderr);
+            exitStatus = 2;
+            return initCommand(arena, 0);
+        }
+    }
+    plan = arenaAlloc(arena, (tokenizer.numRedirections + 1) * sizeof(struct redirection));
+
+    // Every stage's args continue in one array, after the NULL that ends the args of the stage before it
+    smallsh_command = initCommand(arena, numWords + numStages - 1);
+    args = smallsh_command->args;
+    stage = smallsh_command;
+    stage->redirections = plan;
+    for(i = 0; i < tokenizer.numTokens; i++){
+        struct token* token = &tokenizer.tokens[i];
+        if(token->type == PARSE_WORD || token->type == PARSE_ASSIGNMENT){
+            stage->args[stage->argc] = token->text;
+            stage->argc++;
+            if(token->type == PARSE_ASSIGNMENT){
+                stage->numAssignments++;
+            }
+        } else if(token->type == PARSE_PIPE){
+            argc += stage->argc + 1;
+            stage->next = initCommand(arena, 0);
+            stage = stage->next;
+            stage->args = args + argc;
+            stage->redirections = plan + numRedirections;
+        } else {
+            // the word after the operator completes the redirection
+            struct redirection* redirection = &plan[numRedirections];
+            *redirection = tokenizer.redirections[token->offset];
+            redirection->text = tokenizer.tokens[i + 1].text;
+            if(redirection->type == REDIRECT_DUP && strcmp(redirection->text, "-") == 0){
+                redirection->type = REDIRECT_CLOSE;
+            } else if(redirection->type == REDIRECT_DUP && redirection->text[0] != '\0'
+                      && redirection->text[strspn(redirection->text, "0123456789")] == '\0'){
+                redirection->source = atoi(redirection->text);
+            }
+            stage->numRedirections++;
+            numRedirections++;
+            i++;
+        }
+    }
+
+    // flag the command to be run in the background unless background processes are restricted,
+    // every stage of a pipeline runs in the background, or none of them do
+    for(stage = smallsh_command; stage != NULL; stage = stage->next){
+        stage->background = background && runBackground == 1;
+    }
+    smallsh_command->substituted = tokenizer.substituted;
+
+    return smallsh_command;
+}
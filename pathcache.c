@@ -0,0 +1,202 @@
+/***************************************
+ * Smallsh: cache of resolved command paths
+***************************************/
+#include "smallsh.h"
+
+/*
+// Allocate memory and initialize an empty path cache
+*/
+struct pathCache* initPathCache(){
+    struct pathCache* cache = malloc(sizeof(struct pathCache));
+
+    cache->count = 0;
+    cache->capacity = 64;
+    cache->entries = calloc(cache->capacity, sizeof(struct pathEntry));
+    cache->pathVar = NULL;
+    return cache;
+}
+
+/*
+// Remove every entry from a path cache
+*/
+void clearPathCache(struct pathCache* cache){
+    int i;
+
+    for(i = 0; i < cache->capacity; i++){
+        if(cache->entries[i].name != NULL){
+            free(cache->entries[i].name);
+            free(cache->entries[i].path);
+            cache->entries[i].name = NULL;
+        }
+    }
+    cache->count = 0;
+    free(cache->pathVar);
+    cache->pathVar = NULL;
+}
+
+/*
+// Free all memory associated with a path cache
+*/
+void freePathCache(struct pathCache* cache){
+    if(cache != NULL){
+        clearPathCache(cache);
+        free(cache->entries);
+        free(cache);
+    }
+}
+
+/*
+// FNV-1a hash of a string
+*/
+unsigned int hashString(const char* text){
+    unsigned int hash = 2166136261u;
+
+    while(*text != '\0'){
+        hash ^= (unsigned char)*text;
+        hash *= 16777619u;
+        text++;
+    }
+    return hash;
+}
+
+/*
+// Hash a command name to a bucket of the cache
+*/
+static int nameBucket(struct pathCache* cache, const char* name){
+    return (int)(hashString(name) & (unsigned int)(cache->capacity - 1));
+}
+
+/*
+// Find the bucket holding name. Returns the empty bucket where it would be inserted if it is not cached.
+*/
+static int findPathEntry(struct pathCache* cache, const char* name){
+    int bucket = nameBucket(cache, name);
+
+    while(cache->entries[bucket].name != NULL && strcmp(cache->entries[bucket].name, name) != 0){
+        bucket = (bucket + 1) & (cache->capacity - 1);
+    }
+    return bucket;
+}
+
+/*
+// Search the directories of PATH for an executable file called name.
+// Returns the path allocated with malloc(), or NULL if there is none.
+*/
+char* searchPath(const char* name, const char* pathVar){
+    const char* dir = pathVar;
+    const char* end;
+    size_t dirLen;
+    size_t nameLen = strlen(name);
+    char* candidate;
+    struct stat info;
+
+    while(dir != NULL){
+        end = strchr(dir, ':');
+        dirLen = end != NULL ? (size_t)(end - dir) : strlen(dir);
+
+        // an empty PATH entry means the current directory
+        candidate = malloc(dirLen + nameLen + 3);
+        if(dirLen == 0){
+            strcpy(candidate, ".");
+            dirLen = 1;
+        } else {
+            memcpy(candidate, dir, dirLen);
+        }
+        candidate[dirLen] = '/';
+        memcpy(candidate + dirLen + 1, name, nameLen + 1);
+
+        if(stat(candidate, &info) == 0 && S_ISREG(info.st_mode) && access(candidate, X_OK) == 0){
+            return candidate;
+        }
+        free(candidate);
+        dir = end != NULL ? end + 1 : NULL;
+    }
+    return NULL;
+}
+
+/*
+// Resolve a command name to the path to execute.
+// A name containing '/' is used as is. Other names are looked up in the cache and searched for in PATH on a miss.
+// Returns NULL if the command is not found. The returned path belongs to the cache.
+*/
+char* lookupCommand(struct pathCache* cache, char* name){
+    char* pathVar = getVariable(shellVariables, "PATH");
+    char* path;
+    int bucket;
+    int i;
+
+    if(strchr(name, '/') != NULL){
+        return name;
+    }
+    if(pathVar == NULL){
+        pathVar = "/usr/local/bin:/usr/bin:/bin";
+    }
+
+    // forget every path resolved with an old value of PATH
+    if(cache->pathVar == NULL || strcmp(cache->pathVar, pathVar) != 0){
+        clearPathCache(cache);
+        cache->pathVar = strdup(pathVar);
+    }
+
+    bucket = findPathEntry(cache, name);
+    if(cache->entries[bucket].name != NULL){
+        cache->entries[bucket].hits++;
+        return cache->entries[bucket].path;
+    }
+
+    path = searchPath(name, pathVar);
+    if(path == NULL){
+        return NULL;
+    }
+
+    // keep the table at most half full
+    if((cache->count + 1) * 2 > cache->capacity){
+        struct pathEntry* oldEntries = cache->entries;
+        int oldCapacity = cache->capacity;
+
+        cache->capacity *= 2;
+        cache->entries = calloc(cache->capacity, sizeof(struct pathEntry));
+        for(i = 0; i < oldCapacity; i++){
+            if(oldEntries[i].name != NULL){
+                cache->entries[findPathEntry(cache, oldEntries[i].name)] = oldEntries[i];
+            }
+        }
+        free(oldEntries);
+        bucket = findPathEntry(cache, name);
+    }
+
+    cache->entries[bucket].name = strdup(name);
+    cache->entries[bucket].path = path;
+    cache->entries[bucket].hits = 1;
+    cache->count++;
+    return path;
+}
+
+/*
+// Remove the cached path of a command, used when the cached file can no longer be executed
+*/
+void forgetCommand(struct pathCache* cache, char* name){
+    int bucket = findPathEntry(cache, name);
+    int next;
+    int home;
+
+    if(cache->entries[bucket].name == NULL){
+        return;
+    }
+    free(cache->entries[bucket].name);
+    free(cache->entries[bucket].path);
+    cache->entries[bucket].name = NULL;
+    cache->count--;
+
+    // Backward shift deletion, as in pidMapRemoveBucket()
+    next = (bucket + 1) & (cache->capacity - 1);
+    while(cache->entries[next].name != NULL){
+        home = nameBucket(cache, cache->entries[next].name);
+        if(((next - home) & (cache->capacity - 1)) >= ((next - bucket) & (cache->capacity - 1))){
+            cache->entries[bucket] = cache->entries[next];
+            cache->entries[next].name = NULL;
+            bucket = next;
+        }
+        next = (next + 1) & (cache->capacity - 1);
+    }
+}
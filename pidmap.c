@@ -0,0 +1,135 @@
+/***************************************
+ * Smallsh: hash table from pid to an integer value
+***************************************/
+#include "smallsh.h"
+
+/*
+// Allocate memory and initialize an empty pid map
+*/
+struct pidMap* initPidMap(){
+    int i;
+    struct pidMap* map = malloc(sizeof(struct pidMap));
+
+    map->count = 0;
+    map->capacity = 32;
+    map->entries = malloc(map->capacity * sizeof(struct pidEntry));
+    for(i = 0; i < map->capacity; i++){
+        map->entries[i].value = -1;
+    }
+    return map;
+}
+
+/*
+// Free all memory associated with a pid map
+*/
+void freePidMap(struct pidMap* map){
+    if(map != NULL){
+        free(map->entries);
+        free(map);
+    }
+}
+
+/*
+// Hash a pid to its first bucket
+*/
+static int pidBucket(struct pidMap* map, pid_t pid){
+    return (int)(((unsigned int)pid * 2654435761u) & (unsigned int)(map->capacity - 1));
+}
+
+/*
+// Map pid to value, which must not be negative. The map doubles when it becomes half full.
+*/
+void pidMapInsert(struct pidMap* map, pid_t pid, int value){
+    int i;
+    int bucket;
+
+    if((map->count + 1) * 2 > map->capacity){
+        int oldCapacity = map->capacity;
+        struct pidEntry* oldEntries = map->entries;
+
+        map->capacity *= 2;
+        map->entries = malloc(map->capacity * sizeof(struct pidEntry));
+        for(i = 0; i < map->capacity; i++){
+            map->entries[i].value = -1;
+        }
+        for(i = 0; i < oldCapacity; i++){
+            if(oldEntries[i].value != -1){
+                bucket = pidBucket(map, oldEntries[i].pid);
+                while(map->entries[bucket].value != -1){
+                    bucket = (bucket + 1) & (map->capacity - 1);
+                }
+                map->entries[bucket] = oldEntries[i];
+            }
+        }
+        free(oldEntries);
+    }
+
+    bucket = pidBucket(map, pid);
+    while(map->entries[bucket].value != -1){
+        bucket = (bucket + 1) & (map->capacity - 1);
+    }
+    map->entries[bucket].pid = pid;
+    map->entries[bucket].value = value;
+    map->count++;
+}
+
+/*
+// Find the bucket holding pid. Returns -1 if pid is not in the map.
+*/
+int pidMapFind(struct pidMap* map, pid_t pid){
+    int bucket = pidBucket(map, pid);
+
+    while(map->entries[bucket].value != -1){
+        if(map->entries[bucket].pid == pid){
+            return bucket;
+        }
+        bucket = (bucket + 1) & (map->capacity - 1);
+    }
+    return -1;
+}
+
+/*
+// Get the value of pid. Returns -1 if pid is not in the map.
+*/
+int pidMapGet(struct pidMap* map, pid_t pid){
+    int bucket = pidMapFind(map, pid);
+
+    return bucket == -1 ? -1 : map->entries[bucket].value;
+}
+
+/*
+// Remove the entry in bucket from the map
+*/
+void pidMapRemoveBucket(struct pidMap* map, int bucket){
+    int next;
+    int home;
+
+    // Backward shift deletion: move later entries of the probe sequence into the hole so lookups never need tombstones
+    map->entries[bucket].value = -1;
+    next = (bucket + 1) & (map->capacity - 1);
+    while(map->entries[next].value != -1){
+        home = pidBucket(map, map->entries[next].pid);
+        if(((next - home) & (map->capacity - 1)) >= ((next - bucket) & (map->capacity - 1))){
+            map->entries[bucket] = map->entries[next];
+            map->entries[next].value = -1;
+            bucket = next;
+        }
+        next = (next + 1) & (map->capacity - 1);
+    }
+    map->count--;
+}
+
+/*
+// Remove pid from the map. Returns its value, or -1 if pid was not in the map.
+*/
+int pidMapRemove(struct pidMap* map, pid_t pid){
+    int bucket = pidMapFind(map, pid);
+    int value;
+
+    if(bucket == -1){
+        return -1;
+    }
+    value = map->entries[bucket].value;
+    pidMapRemoveBucket(map, bucket);
+    return value;
+}
@@ -0,0 +1,393 @@
+/***************************************
+ * Smallsh: launch policies for CPU affinity, scheduling and resource limits
+ * A policy is given for one command with the launch prefix, or for every background job with the bgpolicy builtin.
+ * It is applied in the child process between fork() and exec(), so no wrapper program has to be started.
+***************************************/
+#include "smallsh.h"
+
+/*
+// Resources that -l can limit, with the names prlimit uses for them
+*/
+static const struct {
+    char* name;
+    int resource;
+} limitNames[] = {
+    {"as", RLIMIT_AS},
+    {"core", RLIMIT_CORE},
+    {"cpu", RLIMIT_CPU},
+    {"data", RLIMIT_DATA},
+    {"fsize", RLIMIT_FSIZE},
+    {"memlock", RLIMIT_MEMLOCK},
+    {"nofile", RLIMIT_NOFILE},
+    {"nproc", RLIMIT_NPROC},
+    {"stack", RLIMIT_STACK},
+};
+
+/*
+// Scheduling policies that -s can select
+*/
+static const struct {
+    char* name;
+    int policy;
+} schedNames[] = {
+    {"other", SCHED_OTHER},
+    {"batch", SCHED_BATCH},
+    {"idle", SCHED_IDLE},
+    {"fifo", SCHED_FIFO},
+    {"rr", SCHED_RR},
+};
+
+#define NUM_LIMIT_NAMES (int)(sizeof(limitNames) / sizeof(limitNames[0]))
+#define NUM_SCHED_NAMES (int)(sizeof(schedNames) / sizeof(schedNames[0]))
+
+/*
+// Parse a whole decimal number into *value. Returns -1 if text is not one.
+*/
+static int parseNumber(char* text, long long* value){
+    char* end;
+
+    errno = 0;
+    *value = strtoll(text, &end, 10);
+    return errno != 0 || end == text || *end != '\0' ? -1 : 0;
+}
+
+/*
+// Parse a CPU list such as "0-3,6" into cpus. Returns -1 if it is malformed.
+*/
+static int parseCpuList(char* text, cpu_set_t* cpus){
+    char* end;
+    long first;
+    long last;
+
+    CPU_ZERO(cpus);
+    while(1){
+        if(!isdigit((unsigned char)*text)){
+            return -1;
+        }
+        first = strtol(text, &end, 10);
+        last = first;
+        if(*end == '-'){
+            text = end + 1;
+            if(!isdigit((unsigned char)*text)){
+                return -1;
+            }
+            last = strtol(text, &end, 10);
+        }
+        if(last < first || last >= CPU_SETSIZE){
+            return -1;
+        }
+        for(; first <= last; first++){
+            CPU_SET(first, cpus);
+        }
+        if(*end == '\0'){
+            return 0;
+        }
+        if(*end != ','){
+            return -1;
+        }
+        text = end + 1;
+    }
+}
+
+/*
+// Parse "policy" or "policy:priority" for -s. Returns -1 if it is malformed.
+*/
+static int parseSched(char* text, struct launchPolicy* policy){
+    char* colon = strchr(text, ':');
+    long long priority = 0;
+    int i;
+
+    if(colon != NULL && parseNumber(colon + 1, &priority) == -1){
+        return -1;
+    }
+    for(i = 0; i < NUM_SCHED_NAMES; i++){
+        if(strncmp(text, schedNames[i].name, colon != NULL ? (size_t)(colon - text) : strlen(text)) == 0
+           && schedNames[i].name[colon != NULL ? colon - text : (long)strlen(text)] == '\0'){
+            policy->schedPolicy = schedNames[i].policy;
+            policy->schedPriority = priority;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+// Set the limit of resource in policy, replacing the one it has. Returns -1 if policy has no room for another limit.
+*/
+static int setLimit(struct launchPolicy* policy, int resource, struct rlimit* limit){
+    int i;
+
+    for(i = 0; i < policy->numLimits && policy->limits[i].resource != resource; i++);
+    if(i == POLICY_MAX_LIMITS){
+        return -1;
+    }
+    if(i == policy->numLimits){
+        policy->numLimits++;
+    }
+    policy->limits[i].resource = resource;
+    policy->limits[i].limit = *limit;
+    return 0;
+}
+
+/*
+// Parse "resource=value" for -l, where value is a number or "unlimited". A resource given again replaces its limit.
+// Returns -1 if it is malformed.
+*/
+static int parseLimit(char* text, struct launchPolicy* policy){
+    char* equals = strchr(text, '=');
+    long long value;
+    struct rlimit limit;
+    int i;
+
+    if(equals == NULL){
+        return -1;
+    }
+    if(strcmp(equals + 1, "unlimited") == 0){
+        limit.rlim_cur = RLIM_INFINITY;
+    } else if(parseNumber(equals + 1, &value) == 0 && value >= 0){
+        limit.rlim_cur = value;
+    } else {
+        return -1;
+    }
+    limit.rlim_max = limit.rlim_cur;
+
+    for(i = 0; i < NUM_LIMIT_NAMES; i++){
+        if(strncmp(text, limitNames[i].name, equals - text) == 0 && limitNames[i].name[equals - text] == '\0'){
+            return setLimit(policy, limitNames[i].resource, &limit);
+        }
+    }
+    return -1;
+}
+
+/*
+// Parse the policy options at the start of args into policy:
+//  -c cpulist          run on the CPUs in cpulist, such as 0-3,6
+//  -n nice             run with the nice value nice
+//  -s policy[:prio]    run with scheduling policy other, batch, idle, fifo or rr, the last two with priority prio
+//  -l resource=value   limit resource (as, core, cpu, data, fsize, memlock, nofile, nproc or stack) to value
+// Options end at the first argument that is not one of them, or after "--".
+// Returns the number of arguments used, or -1 and prints an error if an option is malformed.
+*/
+int parsePolicyOptions(struct launchPolicy* policy, char** args){
+    long long nice;
+    int used = 0;
+    int failed;
+
+    while(args[used] != NULL && args[used][0] == '-' && strchr("cnsl", args[used][1]) != NULL && args[used][2] == '\0'){
+        if(args[used + 1] == NULL){
+            fprintf(stderr, "%s: missing value\n", args[used]);
+            fflush(stderr);
+            return -1;
+        }
+        switch(args[used][1]){
+            case 'c':
+                failed = parseCpuList(args[used + 1], &policy->cpus);
+                policy->set |= POLICY_AFFINITY;
+                break;
+            case 'n':
+                failed = parseNumber(args[used + 1], &nice) == -1 || nice < -20 || nice > 19;
+                policy->nice = nice;
+                policy->set |= POLICY_NICE;
+                break;
+            case 's':
+                failed = parseSched(args[used + 1], policy);
+                policy->set |= POLICY_SCHED;
+                break;
+            default:
+                failed = parseLimit(args[used + 1], policy);
+                policy->set |= POLICY_LIMITS;
+                break;
+        }
+        if(failed){
+            fprintf(stderr, "%s %s: invalid value\n", args[used], args[used + 1]);
+            fflush(stderr);
+            return -1;
+        }
+        used += 2;
+    }
+    if(args[used] != NULL && strcmp(args[used], "--") == 0){
+        used++;
+    }
+    return used;
+}
+
+/*
+// Handle the launch prefix: "launch [options] command" runs command with the policy given by options.
+// The options are removed from the front of the command's arguments.
+// Returns the policy allocated from the arena, or NULL and prints an error if the options are malformed.
+*/
+struct launchPolicy* launchPrefix(struct arena* arena, struct command* smallsh_command){
+    struct launchPolicy* policy = arenaAlloc(arena, sizeof(struct launchPolicy));
+    int used;
+
+    memset(policy, 0, sizeof(struct launchPolicy));
+    used = parsePolicyOptions(policy, smallsh_command->args + 1);
+    if(used == -1){
+        return NULL;
+    }
+    if(used + 1 == smallsh_command->argc){
+        fprintf(stderr, "usage: launch [-c cpulist] [-n nice] [-s policy[:priority]] [-l resource=value] command\n");
+        fflush(stderr);
+        return NULL;
+    }
+    smallsh_command->args += used + 1;
+    smallsh_command->argc -= used + 1;
+    return policy;
+}
+
+/*
+// Find the policy that a command is launched with: the shell's background policy for a background command,
+// with the settings of policy in its place where policy has them.
+// Returns NULL if there is nothing to apply.
+*/
+struct launchPolicy* jobPolicy(struct arena* arena, struct launchPolicy* policy, int background){
+    struct launchPolicy* merged;
+    int i;
+
+    if(!background || backgroundPolicy.set == 0){
+        return policy != NULL && policy->set != 0 ? policy : NULL;
+    }
+    if(policy == NULL || policy->set == 0){
+        return &backgroundPolicy;
+    }
+
+    merged = arenaAlloc(arena, sizeof(struct launchPolicy));
+    *merged = backgroundPolicy;
+    merged->set |= policy->set;
+    if(policy->set & POLICY_AFFINITY){
+        merged->cpus = policy->cpus;
+    }
+    if(policy->set & POLICY_NICE){
+        merged->nice = policy->nice;
+    }
+    if(policy->set & POLICY_SCHED){
+        merged->schedPolicy = policy->schedPolicy;
+        merged->schedPriority = policy->schedPriority;
+    }
+    for(i = 0; i < policy->numLimits; i++){
+        setLimit(merged, policy->limits[i].resource, &policy->limits[i].limit);
+    }
+    return merged;
+}
+
+/*
+// Apply policy to the calling process. Used in a child process just before it calls exec().
+// Returns -1 and prints an error if a setting cannot be applied.
+*/
+int applyPolicy(struct launchPolicy* policy){
+    struct sched_param param = {0};
+    int i;
+
+    for(i = 0; i < policy->numLimits; i++){
+        if(setrlimit(policy->limits[i].resource, &policy->limits[i].limit) == -1){
+            perror("setrlimit()");
+            return -1;
+        }
+    }
+    if((policy->set & POLICY_AFFINITY) && sched_setaffinity(0, sizeof(cpu_set_t), &policy->cpus) == -1){
+        perror("sched_setaffinity()");
+        return -1;
+    }
+    if(policy->set & POLICY_SCHED){
+        param.sched_priority = policy->schedPriority;
+        if(sched_setscheduler(0, policy->schedPolicy, &param) == -1){
+            perror("sched_setscheduler()");
+            return -1;
+        }
+    }
+    if((policy->set & POLICY_NICE) && setpriority(PRIO_PROCESS, 0, policy->nice) == -1){
+        perror("setpriority()");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+// Describe policy for the jobs, status and bgpolicy builtins, such as "cpus 2-3, nice 10, nofile 1024".
+// Returns a string that the caller frees, or NULL if policy is NULL or has no settings.
+*/
+char* describePolicy(struct launchPolicy* policy){
+    char* text = NULL;
+    size_t len = 0;
+    char* separator = "";
+    FILE* out;
+    int cpu;
+    int last;
+    int i;
+    int j;
+
+    if(policy == NULL || policy->set == 0 || (out = open_memstream(&text, &len)) == NULL){
+        return NULL;
+    }
+    if(policy->set & POLICY_AFFINITY){
+        fprintf(out, "cpus ");
+        for(cpu = 0; cpu < CPU_SETSIZE; cpu++){
+            if(CPU_ISSET(cpu, &policy->cpus)){
+                for(last = cpu; last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &policy->cpus); last++);
+                fprintf(out, last > cpu ? "%s%d-%d" : "%s%d", separator, cpu, last);
+                separator = ",";
+                cpu = last;
+            }
+        }
+        separator = ", ";
+    }
+    if(policy->set & POLICY_NICE){
+        fprintf(out, "%snice %d", separator, policy->nice);
+        separator = ", ";
+    }
+    if(policy->set & POLICY_SCHED){
+        for(i = 0; i < NUM_SCHED_NAMES && schedNames[i].policy != policy->schedPolicy; i++);
+        fprintf(out, "%ssched %s", separator, i < NUM_SCHED_NAMES ? schedNames[i].name : "?");
+        if(policy->schedPolicy == SCHED_FIFO || policy->schedPolicy == SCHED_RR){
+            fprintf(out, ":%d", policy->schedPriority);
+        }
+        separator = ", ";
+    }
+    for(i = 0; i < policy->numLimits; i++){
+        for(j = 0; j < NUM_LIMIT_NAMES && limitNames[j].resource != policy->limits[i].resource; j++);
+        if(policy->limits[i].limit.rlim_cur == RLIM_INFINITY){
+            fprintf(out, "%s%s unlimited", separator, limitNames[j].name);
+        } else {
+            fprintf(out, "%s%s %llu", separator, limitNames[j].name, (unsigned long long)policy->limits[i].limit.rlim_cur);
+        }
+        separator = ", ";
+    }
+    fclose(out);
+    return text;
+}
+
+/*
+// The bgpolicy builtin sets the policy that every background job is launched with.
+// Usage: bgpolicy [-r] [options], with the options of parsePolicyOptions(). The options replace the whole policy,
+// -r clears it, and without arguments the current policy is printed.
+// The options of a launch prefix take the place of the matching settings of this policy.
+*/
+void smallsh_bgpolicy(struct command* smallsh_command){
+    struct launchPolicy policy = {0};
+    char** args = smallsh_command->args + 1;
+    char* text;
+    int used;
+
+    exitStatus = 0;
+    if(args[0] == NULL){
+        text = describePolicy(&backgroundPolicy);
+        printf("background policy: %s\n", text != NULL ? text : "none");
+        fflush(stdout);
+        free(text);
+        return;
+    }
+    if(strcmp(args[0], "-r") == 0 && args[1] == NULL){
+        memset(&backgroundPolicy, 0, sizeof(struct launchPolicy));
+        return;
+    }
+    used = parsePolicyOptions(&policy, args);
+    if(used == -1 || args[used] != NULL){
+        if(used != -1){
+            fprintf(stderr, "usage: bgpolicy [-r] [-c cpulist] [-n nice] [-s policy[:priority]] [-l resource=value]\n");
+            fflush(stderr);
+        }
+        exitStatus = 2;
+        return;
+    }
+    backgroundPolicy = policy;
+}
@@ -0,0 +1,267 @@
+/***************************************
+ * Smallsh: redirections
+ * parseInput() compiles the redirections of each stage into a plan, applied in order after the stage's pipes
+ * are connected: in the child before exec(), as posix_spawn() file actions, or to smallsh itself for a builtin.
+ * Every fd opened for the plan is close-on-exec, so a child never has to close what it opened.
+***************************************/
+#include "smallsh.h"
+#include <sys/uio.h>
+
+/*
+// Return an fd open on /dev/null for reading and writing. It is opened once, close-on-exec, and children that
+// need it dup it onto stdin or stdout.
+*/
+int nullDevice(){
+    static int devNull = -1;
+
+    if(devNull == -1){
+        devNull = open("/dev/null", O_RDWR | O_CLOEXEC);
+    }
+    return devNull;
+}
+
+/*
+// Return 1 if the redirections of a command change fd
+*/
+int redirectsFd(struct command* smallsh_command, int fd){
+    int i;
+
+    for(i = 0; i < smallsh_command->numRedirections; i++){
+        if(smallsh_command->redirections[i].fd == fd){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+// Return the file of the last < redirection of stdin, or NULL if there is none
+*/
+char* inputFile(struct command* smallsh_command){
+    struct redirection* redirection;
+    int i;
+
+    for(i = smallsh_command->numRedirections - 1; i >= 0; i--){
+        redirection = &smallsh_command->redirections[i];
+        if(redirection->fd == STDIN_FILENO){
+            return redirection->type == REDIRECT_OPEN ? redirection->text : NULL;
+        }
+    }
+    return NULL;
+}
+
+/*
+// Return 1 if fd is open for the commands smallsh runs. smallsh opens all of its own fds close-on-exec, such as the
+// signalfd, the history file and saved fds, so >& and <& cannot reach them.
+*/
+static int commandFd(int fd){
+    int flags = fcntl(fd, F_GETFD);
+
+    return flags != -1 && !(flags & FD_CLOEXEC);
+}
+
+/*
+// Return a close-on-exec fd that reads text followed by a newline, for a <<< here-string.
+// The text is kept in a memory file rather than a pipe, so it can be any size without a writer.
+*/
+static int hereString(char* text){
+    struct iovec parts[2] = {{text, strlen(text)}, {"\n", 1}};
+    int fd = memfd_create("here-string", MFD_CLOEXEC);
+
+    if(fd == -1){
+        return -1;
+    }
+    if(writev(fd, parts, 2) != (ssize_t)(parts[0].iov_len + 1) || lseek(fd, 0, SEEK_SET) == -1){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+// Apply one redirection to the fds of the calling process.
+// A file or here-string is opened close-on-exec and copied onto the target fd; with closeOpened the fd it was
+// opened on is closed afterwards, otherwise it is left for exec() to close.
+// Returns -1 and prints an error if the redirection fails.
+*/
+static int applyRedirection(struct redirection* redirection, int closeOpened){
+    int fd;
+
+    switch(redirection->type){
+        case REDIRECT_CLOSE:
+            close(redirection->fd);
+            return 0;
+        case REDIRECT_DUP:
+            if(redirection->source == -1 || !commandFd(redirection->source)){
+                errno = EBADF;
+            } else if(redirection->source == redirection->fd){
+                return fcntl(redirection->fd, F_SETFD, 0);
+            } else if(dup3(redirection->source, redirection->fd, 0) != -1){
+                return 0;
+            }
+            perror(redirection->text);
+            fflush(stderr);
+            return -1;
+        case REDIRECT_STRING:
+            fd = hereString(redirection->text);
+            break;
+        default:
+            fd = open(redirection->text, redirection->flags | O_CLOEXEC, 0640);
+    }
+
+    if(fd == -1){
+        perror(redirection->text);
+        fflush(stderr);
+        return -1;
+    }
+    if(fd == redirection->fd){
+        // the target was closed, so the file was opened on it directly
+        return fcntl(fd, F_SETFD, 0);
+    }
+    dup3(fd, redirection->fd, 0);
+    if(closeOpened){
+        close(fd);
+    }
+    return 0;
+}
+
+/*
+// Apply every redirection of a command in a child before exec().
+// Returns -1 and prints an error if one of them fails.
+*/
+int applyRedirections(struct command* smallsh_command){
+    int i;
+
+    for(i = 0; i < smallsh_command->numRedirections; i++){
+        if(applyRedirection(&smallsh_command->redirections[i], 0) == -1){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+// Return 1 if fd will be open in a spawned child when the redirection at index of a command is applied
+*/
+static int spawnedFdOpen(struct command* smallsh_command, int index, int fd){
+    int i;
+
+    for(i = index - 1; i >= 0; i--){
+        if(smallsh_command->redirections[i].fd == fd){
+            return smallsh_command->redirections[i].type != REDIRECT_CLOSE;
+        }
+    }
+    return commandFd(fd);
+}
+
+/*
+// Add the redirections of a command to the file actions of posix_spawn().
+// Files and here-strings are opened in smallsh and copied by the child, so an error names the file as it does
+// when the child opens it after fork(). Their fds are stored in openFds, which needs room for one per redirection,
+// to be closed once the child is spawned.
+// Returns the number of fds in openFds, or -1 and prints an error if a redirection cannot be set up.
+*/
+int spawnRedirections(struct command* smallsh_command, posix_spawn_file_actions_t* actions, int* openFds){
+    struct redirection* redirection;
+    int numOpen = 0;
+    int fd;
+    int i;
+
+    for(i = 0; i < smallsh_command->numRedirections; i++){
+        redirection = &smallsh_command->redirections[i];
+        if(redirection->type == REDIRECT_CLOSE){
+            posix_spawn_file_actions_addclose(actions, redirection->fd);
+            continue;
+        }
+        if(redirection->type == REDIRECT_DUP){
+            fd = redirection->source != -1 && spawnedFdOpen(smallsh_command, i, redirection->source)
+                 ? redirection->source : -1;
+            errno = EBADF;
+        } else if(redirection->type == REDIRECT_STRING){
+            fd = openFds[numOpen] = hereString(redirection->text);
+            numOpen += fd != -1;
+        } else {
+            fd = openFds[numOpen] = open(redirection->text, redirection->flags | O_CLOEXEC, 0640);
+            numOpen += fd != -1;
+        }
+
+        if(fd == -1){
+            // a >& or <& word that is not an fd, or a file or here-string that could not be opened
+            perror(redirection->text);
+            fflush(stderr);
+            while(numOpen > 0){
+                close(openFds[--numOpen]);
+            }
+            return -1;
+        }
+        if(fd != redirection->fd || redirection->type != REDIRECT_DUP){
+            posix_spawn_file_actions_adddup2(actions, fd, redirection->fd);
+        }
+    }
+    return numOpen;
+}
+
+/*
+// Put back the fds saved for the first count redirections of a command, in reverse order
+*/
+static void restoreFds(struct command* smallsh_command, int* saved, int count){
+    int fd;
+    int i;
+
+    for(i = count - 1; i >= 0; i--){
+        fd = smallsh_command->redirections[i].fd;
+        if(saved[i] == -1){
+            close(fd);
+        } else if(saved[i] != -2){
+            dup2(saved[i], fd);
+            close(saved[i]);
+        }
+    }
+}
+
+/*
+// Apply the redirections of a command that runs inside smallsh to the fds of smallsh itself.
+// The fds they replace are saved in *saved, allocated from the arena, for restoreShell() to put back.
+// With ownInput set < files for stdin are left for the command to open.
+// Returns -1 and prints an error if a redirection fails, in which case nothing is redirected.
+*/
+int redirectShell(struct command* smallsh_command, int ownInput, int** saved){
+    struct redirection* redirection;
+    int i;
+    int j;
+
+    fflush(stdout);
+    *saved = NULL;
+    if(smallsh_command->numRedirections == 0){
+        return 0;
+    }
+    *saved = arenaAlloc(commandArena, smallsh_command->numRedirections * sizeof(int));
+    for(i = 0; i < smallsh_command->numRedirections; i++){
+        redirection = &smallsh_command->redirections[i];
+        (*saved)[i] = -2;
+        if(ownInput && redirection->fd == STDIN_FILENO && redirection->type == REDIRECT_OPEN){
+            continue;
+        }
+
+        // each fd is saved before the first redirection that changes it, -1 if it was not open
+        for(j = 0; j < i && ((*saved)[j] == -2 || smallsh_command->redirections[j].fd != redirection->fd); j++);
+        if(j == i){
+            (*saved)[i] = fcntl(redirection->fd, F_DUPFD_CLOEXEC, 10);
+        }
+        if(applyRedirection(redirection, 1) == -1){
+            restoreFds(smallsh_command, *saved, i + 1);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+// Undo the redirections made by redirectShell()
+*/
+void restoreShell(struct command* smallsh_command, int* saved){
+    fflush(stdout);
+    if(saved != NULL){
+        restoreFds(smallsh_command, saved, smallsh_command->numRedirections);
+    }
+}
@@ -0,0 +1,908 @@
+/***************************************
+ * Smallsh: script parser and interpreter
+ * Command lists, &&, ||, if, while, until, for, { } groups and functions run inside smallsh.
+***************************************/
+#include "smallsh.h"
+
+#define TOKEN_WORD 0
+#define TOKEN_SEMI 1
+#define TOKEN_AND 2
+#define TOKEN_OR 3
+#define TOKEN_NEWLINE 4
+#define TOKEN_END 5
+
+#define MAX_FUNCTION_DEPTH 1000
+
+/*
+// Splits the lines of a script into tokens, reading the lines with getInput() only when they are needed.
+// A simple command never spans lines, so its words can be copied out of the line before the next one is read.
+*/
+struct lexer{
+    char* pos;                  // next character of the current line
+    int needLine;               // 1 if the next token is on a line that has not been read yet
+    int lineNumber;
+    char* prompt;               // prompt for the next line when reading from stdin
+    int peeked;                 // 1 if type, start and len hold a token that has not been consumed
+    int type;
+    char* start;                // text of a TOKEN_WORD
+    size_t len;
+    int error;                  // 1 once a syntax error was reported
+};
+
+static char* reservedWords[] = {"then", "elif", "else", "fi", "do", "done", "}", NULL};
+
+/*
+// Allocate an empty script
+*/
+struct script* initScript(){
+    struct script* script = calloc(1, sizeof(struct script));
+
+    script->nodeCapacity = 64;
+    script->nodes = malloc(script->nodeCapacity * sizeof(struct scriptNode));
+    script->stringsCapacity = 1024;
+    script->strings = malloc(script->stringsCapacity);
+    script->root = -1;
+    script->references = 1;
+    return script;
+}
+
+/*
+// Forget the nodes of a script so that its memory can be reused for the next command line
+*/
+void resetScript(struct script* script){
+    script->numNodes = 0;
+    script->stringsLen = 0;
+    script->root = -1;
+}
+
+/*
+// Drop a reference to a script and free it when nothing refers to it any more.
+// A script loaded from the cache only maps the cache file.
+*/
+void releaseScript(struct script* script){
+    if(script == NULL || --script->references > 0){
+        return;
+    }
+    if(script->mapping != NULL){
+        munmap(script->mapping, script->mappingLen);
+    } else {
+        free(script->nodes);
+        free(script->strings);
+    }
+    free(script);
+}
+
+/*
+// Append a node to a script and return its index. All of its links start out as -1.
+*/
+static int addNode(struct script* script, int type){
+    struct scriptNode* node;
+
+    if(script->numNodes == script->nodeCapacity){
+        script->nodeCapacity *= 2;
+        script->nodes = realloc(script->nodes, script->nodeCapacity * sizeof(struct scriptNode));
+    }
+    node = &script->nodes[script->numNodes];
+    node->type = type;
+    node->text = -1;
+    node->words = -1;
+    node->first = -1;
+    node->second = -1;
+    node->third = -1;
+    node->next = -1;
+    return script->numNodes++;
+}
+
+/*
+// Append len bytes of text and a '\0' to the strings of a script, returning the offset of the copy
+*/
+static int addString(struct script* script, const char* text, size_t len){
+    int offset = script->stringsLen;
+
+    while(script->stringsLen + len + 1 > script->stringsCapacity){
+        script->stringsCapacity *= 2;
+        script->strings = realloc(script->strings, script->stringsCapacity);
+    }
+    memcpy(script->strings + offset, text, len);
+    script->strings[offset + len] = '\0';
+    script->stringsLen += len + 1;
+    return offset;
+}
+
+/*
+// Look at the next token without consuming it, reading the next line first if needed
+*/
+static int peekToken(struct lexer* lexer){
+    char* line;
+
+    if(lexer->peeked || lexer->type == TOKEN_END){
+        return lexer->type;
+    }
+    lexer->peeked = 1;
+
+    if(lexer->needLine){
+        line = getInput(lexer->prompt);
+        if(line == NULL){
+            lexer->type = TOKEN_END;
+            return lexer->type;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        lexer->pos = line;
+        lexer->needLine = 0;
+        lexer->lineNumber++;
+        lexer->prompt = "> ";
+    }
+
+    lexer->pos += strspn(lexer->pos, " \t");
+    lexer->start = lexer->pos;
+    if(*lexer->pos == '\0' || *lexer->pos == '#'){
+        // a comment runs to the end of the line
+        lexer->type = TOKEN_NEWLINE;
+    } else if(*lexer->pos == ';'){
+        lexer->type = TOKEN_SEMI;
+        lexer->pos++;
+    } else {
+        lexer->pos = wordEnd(lexer->pos);
+        lexer->len = lexer->pos - lexer->start;
+        lexer->type = TOKEN_WORD;
+        if(lexer->len == 2 && strncmp(lexer->start, "&&", 2) == 0){
+            lexer->type = TOKEN_AND;
+        } else if(lexer->len == 2 && strncmp(lexer->start, "||", 2) == 0){
+            lexer->type = TOKEN_OR;
+        }
+    }
+    return lexer->type;
+}
+
+static void consumeToken(struct lexer* lexer){
+    lexer->peeked = 0;
+    if(lexer->type == TOKEN_NEWLINE){
+        lexer->needLine = 1;
+    }
+}
+
+/*
+// Return 1 if the next token is the word word
+*/
+static int nextIs(struct lexer* lexer, const char* word){
+    return peekToken(lexer) == TOKEN_WORD && strlen(word) == lexer->len && strncmp(lexer->start, word, lexer->len) == 0;
+}
+
+/*
+// Return 1 if the next token is one of the words in a NULL terminated list
+*/
+static int nextIsOneOf(struct lexer* lexer, char** words){
+    for(; words != NULL && words[0] != NULL; words++){
+        if(nextIs(lexer, words[0])){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+// Report a syntax error at the next token. Only the first error of a parse is printed.
+*/
+static void syntaxError(struct lexer* lexer){
+    if(lexer->error){
+        return;
+    }
+    lexer->error = 1;
+    if(batch != NULL){
+        fprintf(stderr, "smallsh: line %d: ", lexer->lineNumber);
+    } else {
+        fprintf(stderr, "smallsh: ");
+    }
+    switch(peekToken(lexer)){
+        case TOKEN_END: fprintf(stderr, "syntax error: unexpected end of input\n"); break;
+        case TOKEN_NEWLINE: fprintf(stderr, "syntax error near newline\n"); break;
+        case TOKEN_SEMI: fprintf(stderr, "syntax error near ';'\n"); break;
+        default: fprintf(stderr, "syntax error near '%.*s'\n", (int)lexer->len, lexer->start); break;
+    }
+    fflush(stderr);
+}
+
+/*
+// Consume the word word, or report a syntax error if it is not next
+*/
+static void expectWord(struct lexer* lexer, const char* word){
+    if(nextIs(lexer, word)){
+        consumeToken(lexer);
+    } else {
+        syntaxError(lexer);
+    }
+}
+
+/*
+// Consume any ';' and newlines
+*/
+static void skipSeparators(struct lexer* lexer){
+    while(!lexer->error && (peekToken(lexer) == TOKEN_SEMI || peekToken(lexer) == TOKEN_NEWLINE)){
+        consumeToken(lexer);
+    }
+}
+
+static int parseAndOr(struct lexer* lexer, struct script* script);
+static int parseCommand(struct lexer* lexer, struct script* script);
+
+/*
+// Parse commands separated by ';' and newlines until one of the terminators starts a command or the input ends.
+// With oneLine set, the list also ends at the first newline that is not inside a compound command.
+// Returns the first node of the list, linked to the others through next, or -1 if the list is empty.
+*/
+static int parseList(struct lexer* lexer, struct script* script, char** terminators, int oneLine){
+    int first = -1;
+    int last = -1;
+    int node;
+    int type;
+
+    while(!lexer->error){
+        type = peekToken(lexer);
+        if(type == TOKEN_NEWLINE && oneLine){
+            consumeToken(lexer);
+            break;
+        }
+        if(type == TOKEN_SEMI || type == TOKEN_NEWLINE){
+            consumeToken(lexer);
+            continue;
+        }
+        if(type == TOKEN_END || nextIsOneOf(lexer, terminators)){
+            break;
+        }
+
+        node = parseAndOr(lexer, script);
+        if(lexer->error){
+            break;
+        }
+        if(first == -1){
+            first = node;
+        } else {
+            script->nodes[last].next = node;
+        }
+        last = node;
+
+        // a command must be followed by a separator or by the keyword that ends the list
+        if(peekToken(lexer) == TOKEN_WORD && !nextIsOneOf(lexer, terminators)){
+            syntaxError(lexer);
+        }
+    }
+    return first;
+}
+
+/*
+// Parse commands joined by && and ||, which group from the left
+*/
+static int parseAndOr(struct lexer* lexer, struct script* script){
+    int node = parseCommand(lexer, script);
+    int type;
+    int right;
+    int joined;
+
+    while(!lexer->error && (peekToken(lexer) == TOKEN_AND || peekToken(lexer) == TOKEN_OR)){
+        type = lexer->type;
+        consumeToken(lexer);
+        while(peekToken(lexer) == TOKEN_NEWLINE){
+            consumeToken(lexer);
+        }
+        right = parseCommand(lexer, script);
+        joined = addNode(script, type == TOKEN_AND ? NODE_AND : NODE_OR);
+        script->nodes[joined].first = node;
+        script->nodes[joined].second = right;
+        node = joined;
+    }
+    return node;
+}
+
+/*
+// Parse the rest of an if command after "if" or "elif". An elif is stored as an if node in the else part.
+*/
+static int parseIf(struct lexer* lexer, struct script* script){
+    char* thenEnd[] = {"then", NULL};
+    char* elseEnd[] = {"elif", "else", "fi", NULL};
+    char* fiEnd[] = {"fi", NULL};
+    int node = addNode(script, NODE_IF);
+    int condition;
+    int thenPart;
+    int elsePart = -1;
+
+    condition = parseList(lexer, script, thenEnd, 0);
+    if(condition == -1){
+        syntaxError(lexer);
+    }
+    expectWord(lexer, "then");
+    thenPart = parseList(lexer, script, elseEnd, 0);
+    if(thenPart == -1){
+        syntaxError(lexer);
+    }
+
+    if(!lexer->error && nextIs(lexer, "elif")){
+        consumeToken(lexer);
+        elsePart = parseIf(lexer, script);
+    } else {
+        if(!lexer->error && nextIs(lexer, "else")){
+            consumeToken(lexer);
+            elsePart = parseList(lexer, script, fiEnd, 0);
+        }
+        expectWord(lexer, "fi");
+    }
+
+    script->nodes[node].first = condition;
+    script->nodes[node].second = thenPart;
+    script->nodes[node].third = elsePart;
+    return node;
+}
+
+/*
+// Parse "do list done", the body of a loop
+*/
+static int parseLoopBody(struct lexer* lexer, struct script* script){
+    char* doneEnd[] = {"done", NULL};
+    int body;
+
+    expectWord(lexer, "do");
+    body = parseList(lexer, script, doneEnd, 0);
+    expectWord(lexer, "done");
+    return body;
+}
+
+/*
+// Parse the rest of a while or until command
+*/
+static int parseWhile(struct lexer* lexer, struct script* script, int type){
+    char* doEnd[] = {"do", NULL};
+    int node = addNode(script, type);
+    int condition = parseList(lexer, script, doEnd, 0);
+    int body;
+
+    if(condition == -1){
+        syntaxError(lexer);
+    }
+    body = parseLoopBody(lexer, script);
+    script->nodes[node].first = condition;
+    script->nodes[node].second = body;
+    return node;
+}
+
+/*
+// Return 1 if the len characters at name are a valid variable name
+*/
+static int validName(char* name, size_t len){
+    size_t i;
+
+    if(len == 0 || isdigit((unsigned char)name[0])){
+        return 0;
+    }
+    for(i = 0; i < len; i++){
+        if(name[i] != '_' && !isalnum((unsigned char)name[i])){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+// Parse the rest of a for command: "name [in words...] ; do list done".
+// The words are kept as text and expanded each time the loop runs. Without "in" the loop runs over $1, $2, ...
+*/
+static int parseFor(struct lexer* lexer, struct script* script){
+    int node = addNode(script, NODE_FOR);
+    int words = -1;
+    int name;
+    char* start;
+    char* end;
+
+    if(peekToken(lexer) != TOKEN_WORD || !validName(lexer->start, lexer->len)){
+        syntaxError(lexer);
+        return node;
+    }
+    name = addString(script, lexer->start, lexer->len);
+    consumeToken(lexer);
+
+    if(nextIs(lexer, "in")){
+        consumeToken(lexer);
+        start = end = lexer->pos;
+        while(peekToken(lexer) == TOKEN_WORD){
+            if(end == start){
+                start = lexer->start;
+            }
+            end = lexer->start + lexer->len;
+            consumeToken(lexer);
+        }
+        words = addString(script, start, end - start);
+        if(peekToken(lexer) != TOKEN_SEMI && peekToken(lexer) != TOKEN_NEWLINE){
+            syntaxError(lexer);
+        }
+    }
+    skipSeparators(lexer);
+
+    script->nodes[node].text = name;
+    script->nodes[node].words = words;
+    script->nodes[node].second = parseLoopBody(lexer, script);
+    return node;
+}
+
+/*
+// Parse "{ list }", a group of commands
+*/
+static int parseGroup(struct lexer* lexer, struct script* script){
+    char* groupEnd[] = {"}", NULL};
+    int node = addNode(script, NODE_GROUP);
+    int body;
+
+    expectWord(lexer, "{");
+    body = parseList(lexer, script, groupEnd, 0);
+    if(body == -1){
+        syntaxError(lexer);
+    }
+    expectWord(lexer, "}");
+    script->nodes[node].first = body;
+    return node;
+}
+
+/*
+// Parse the body of a function definition, which is a { } group that may start on the next line
+*/
+static int parseFunction(struct lexer* lexer, struct script* script, char* name, size_t len){
+    int node = addNode(script, NODE_FUNCTION);
+    int body;
+
+    if(!validName(name, len)){
+        syntaxError(lexer);
+        return node;
+    }
+    script->nodes[node].text = addString(script, name, len);
+    while(peekToken(lexer) == TOKEN_NEWLINE){
+        consumeToken(lexer);
+    }
+    body = parseGroup(lexer, script);
+    script->nodes[node].first = body;
+    return node;
+}
+
+/*
+// Parse one command: a compound command, a function definition or a simple command.
+// A simple command is stored as its text, which is expanded and split by parseInput() each time it runs.
+*/
+static int parseCommand(struct lexer* lexer, struct script* script){
+    int node;
+    char* start;
+    char* end;
+
+    if(peekToken(lexer) != TOKEN_WORD || nextIsOneOf(lexer, reservedWords)){
+        syntaxError(lexer);
+        return -1;
+    }
+
+    if(nextIs(lexer, "if")){
+        consumeToken(lexer);
+        return parseIf(lexer, script);
+    }
+    if(nextIs(lexer, "while") || nextIs(lexer, "until")){
+        int type = nextIs(lexer, "while") ? NODE_WHILE : NODE_UNTIL;
+        consumeToken(lexer);
+        return parseWhile(lexer, script, type);
+    }
+    if(nextIs(lexer, "for")){
+        consumeToken(lexer);
+        return parseFor(lexer, script);
+    }
+    if(nextIs(lexer, "{")){
+        return parseGroup(lexer, script);
+    }
+    if(nextIs(lexer, "function")){
+        consumeToken(lexer);
+        if(peekToken(lexer) != TOKEN_WORD){
+            syntaxError(lexer);
+            return -1;
+        }
+        start = lexer->start;
+        end = start + lexer->len;
+        consumeToken(lexer);
+        return parseFunction(lexer, script, start, end - start);
+    }
+
+    // name() or name () starts a function definition
+    start = lexer->start;
+    end = start + lexer->len;
+    consumeToken(lexer);
+    if(end - start > 2 && strncmp(end - 2, "()", 2) == 0){
+        return parseFunction(lexer, script, start, end - start - 2);
+    }
+    if(nextIs(lexer, "()")){
+        consumeToken(lexer);
+        return parseFunction(lexer, script, start, end - start);
+    }
+
+    while(peekToken(lexer) == TOKEN_WORD){
+        end = lexer->start + lexer->len;
+        consumeToken(lexer);
+    }
+    node = addNode(script, NODE_COMMAND);
+    script->nodes[node].text = addString(script, start, end - start);
+    return node;
+}
+
+/*
+// Parse commands into script, reading lines with getInput().
+// With oneLine set, it parses one line from stdin, plus the lines needed to finish a compound command that it starts.
+// Otherwise it parses everything up to the end of the input.
+// Returns 0 on success, 1 after a syntax error and -1 if the input ended before anything was read.
+*/
+int parseScript(struct script* script, int oneLine){
+    struct lexer lexer = {0};
+
+    lexer.needLine = 1;
+    lexer.prompt = ":";
+    script->root = parseList(&lexer, script, NULL, oneLine);
+    if(lexer.error){
+        script->root = -1;
+        return 1;
+    }
+    if(lexer.lineNumber == 0){
+        return -1;
+    }
+    return 0;
+}
+
+/*
+// Allocate an empty function table
+*/
+struct functionTable* initFunctionTable(){
+    struct functionTable* table = malloc(sizeof(struct functionTable));
+
+    table->count = 0;
+    table->capacity = 16;
+    table->entries = calloc(table->capacity, sizeof(struct scriptFunction));
+    return table;
+}
+
+/*
+// Free all memory associated with a function table
+*/
+void freeFunctionTable(struct functionTable* table){
+    int i;
+
+    if(table != NULL){
+        for(i = 0; i < table->capacity; i++){
+            if(table->entries[i].name != NULL){
+                free(table->entries[i].name);
+                releaseScript(table->entries[i].body);
+            }
+        }
+        free(table->entries);
+        free(table);
+    }
+}
+
+/*
+// Return the bucket that holds name, or the empty bucket where it would be inserted
+*/
+static int functionBucket(struct functionTable* table, char* name){
+    int bucket = hashString(name) & (table->capacity - 1);
+
+    while(table->entries[bucket].name != NULL && strcmp(table->entries[bucket].name, name) != 0){
+        bucket = (bucket + 1) & (table->capacity - 1);
+    }
+    return bucket;
+}
+
+/*
+// Find the function with the given name, or return NULL if there is none
+*/
+struct scriptFunction* findFunction(struct functionTable* table, char* name){
+    int bucket;
+
+    if(table->count == 0){
+        return NULL;
+    }
+    bucket = functionBucket(table, name);
+    return table->entries[bucket].name != NULL ? &table->entries[bucket] : NULL;
+}
+
+static int copyList(struct script* to, struct script* from, int node);
+
+/*
+// Copy a node and everything below it from one script to another, returning the index of the copy
+*/
+static int copyNode(struct script* to, struct script* from, int node){
+    struct scriptNode* source = &from->nodes[node];
+    int copy = addNode(to, source->type);
+    int text = -1;
+    int words = -1;
+    int first = copyList(to, from, source->first);
+    int second = copyList(to, from, source->second);
+    int third = copyList(to, from, source->third);
+
+    if(source->text != -1){
+        text = addString(to, from->strings + source->text, strlen(from->strings + source->text));
+    }
+    if(source->words != -1){
+        words = addString(to, from->strings + source->words, strlen(from->strings + source->words));
+    }
+    to->nodes[copy].text = text;
+    to->nodes[copy].words = words;
+    to->nodes[copy].first = first;
+    to->nodes[copy].second = second;
+    to->nodes[copy].third = third;
+    return copy;
+}
+
+/*
+// Copy a list of nodes linked by next from one script to another
+*/
+static int copyList(struct script* to, struct script* from, int node){
+    int first = -1;
+    int last = -1;
+    int copy;
+
+    for(; node != -1; node = from->nodes[node].next){
+        copy = copyNode(to, from, node);
+        if(first == -1){
+            first = copy;
+        } else {
+            to->nodes[last].next = copy;
+        }
+        last = copy;
+    }
+    return first;
+}
+
+/*
+// Define a function, or replace the definition of one.
+// The body is copied into a script of its own, so the command line or script that defined it can be freed.
+*/
+void defineFunction(struct functionTable* table, char* name, struct script* from, int body){
+    struct script* script = initScript();
+    int bucket;
+    int i;
+
+    script->root = copyList(script, from, body);
+
+    bucket = functionBucket(table, name);
+    if(table->entries[bucket].name != NULL){
+        releaseScript(table->entries[bucket].body);
+        table->entries[bucket].body = script;
+        return;
+    }
+    table->entries[bucket].name = strdup(name);
+    table->entries[bucket].body = script;
+    table->count++;
+
+    // keep the load factor at most 3/4
+    if(table->count * 4 > table->capacity * 3){
+        struct scriptFunction* old = table->entries;
+        int oldCapacity = table->capacity;
+
+        table->capacity *= 2;
+        table->entries = calloc(table->capacity, sizeof(struct scriptFunction));
+        for(i = 0; i < oldCapacity; i++){
+            if(old[i].name != NULL){
+                table->entries[functionBucket(table, old[i].name)] = old[i];
+            }
+        }
+        free(old);
+    }
+}
+
+/*
+// Run a function with the arguments of a command as $1, $2, ...
+// The < and > of the command apply to the whole body. A return in the body ends the function.
+*/
+void callFunction(struct scriptFunction* function, struct command* smallsh_command){
+    static int depth = 0;
+    struct script* body = function->body;
+    char** savedArgs = positionalArgs;
+    int savedCount = positionalCount;
+    int* saved;
+
+    if(depth == MAX_FUNCTION_DEPTH){
+        fprintf(stderr, "%s: maximum function nesting exceeded\n", smallsh_command->args[0]);
+        fflush(stderr);
+        exitStatus = 1;
+        return;
+    }
+    if(redirectShell(smallsh_command, 0, &saved) == -1){
+        exitStatus = 1;
+        return;
+    }
+
+    // the body stays alive while it runs, even if it redefines the function
+    body->references++;
+    depth++;
+    positionalArgs = smallsh_command->args;
+    positionalCount = smallsh_command->argc - 1;
+
+    runList(body, body->root);
+    if(scriptControl == CONTROL_RETURN){
+        scriptControl = CONTROL_NONE;
+    }
+
+    positionalArgs = savedArgs;
+    positionalCount = savedCount;
+    depth--;
+    releaseScript(body);
+    restoreShell(smallsh_command, saved);
+}
+
+/*
+// Run the text of a simple command through parseInput() and runCommand().
+// Everything the command allocates is released afterwards, so a loop runs in constant memory.
+*/
+static void runScriptCommand(char* text){
+    struct arenaMark mark = arenaMark(commandArena);
+    size_t len = strlen(text);
+    char* line = arenaAlloc(commandArena, len + 1);
+
+    memcpy(line, text, len + 1);
+    handleSignals(0);
+    foregroundInterrupted = 0;
+    runCommand(parseInput(commandArena, line), backgroundJobs);
+    arenaRelease(commandArena, mark);
+
+    // a foreground command killed by SIGINT interrupts the script typed at the prompt, as it would a single command.
+    // A command that exits with status 130 on its own does not.
+    if(batch == NULL && foregroundInterrupted){
+        scriptControl = CONTROL_INTERRUPT;
+    }
+}
+
+/*
+// Handle a pending break or continue after an iteration of a loop.
+// Returns 1 if the loop should stop.
+*/
+static int endLoop(){
+    if(scriptControl == CONTROL_CONTINUE){
+        scriptControl = CONTROL_NONE;
+        return 0;
+    }
+    if(scriptControl == CONTROL_BREAK){
+        scriptControl = CONTROL_NONE;
+        return 1;
+    }
+    return scriptControl != CONTROL_NONE;
+}
+
+/*
+// Run the body of a for loop once for every word, with the loop variable set to the word
+*/
+static void runFor(struct script* script, struct scriptNode* node){
+    struct arenaMark mark = arenaMark(commandArena);
+    char* name = script->strings + node->text;
+    int status = 0;
+    int i;
+
+    if(node->words == -1){
+        // for name; do ... runs over the positional parameters
+        char** args = positionalArgs;
+        int count = positionalCount;
+        for(i = 1; i <= count; i++){
+            setVariable(shellVariables, name, args[i], 0);
+            runList(script, node->second);
+            status = exitStatus;
+            if(endLoop()){
+                break;
+            }
+        }
+    } else {
+        // the words are split and expanded like the arguments of a command
+        size_t len = strlen(script->strings + node->words);
+        char* words = arenaAlloc(commandArena, len + 1);
+        struct command* list;
+
+        memcpy(words, script->strings + node->words, len + 1);
+        list = parseInput(commandArena, words);
+        for(i = 0; i < list->argc; i++){
+            setVariable(shellVariables, name, list->args[i], 0);
+            runList(script, node->second);
+            status = exitStatus;
+            if(endLoop()){
+                break;
+            }
+        }
+    }
+    exitStatus = status;
+    arenaRelease(commandArena, mark);
+}
+
+/*
+// Run one node of a script
+*/
+static void runNode(struct script* script, int index){
+    struct scriptNode* node = &script->nodes[index];
+    int status = 0;
+
+    switch(node->type){
+        case NODE_COMMAND:
+            runScriptCommand(script->strings + node->text);
+            break;
+        case NODE_AND:
+        case NODE_OR:
+            runList(script, node->first);
+            if(scriptControl == CONTROL_NONE && (exitStatus == 0) == (node->type == NODE_AND)){
+                runList(script, node->second);
+            }
+            break;
+        case NODE_IF:
+            runList(script, node->first);
+            if(scriptControl != CONTROL_NONE){
+                break;
+            }
+            if(exitStatus == 0){
+                runList(script, node->second);
+            } else if(node->third != -1){
+                runList(script, node->third);
+            } else {
+                exitStatus = 0;
+            }
+            break;
+        case NODE_WHILE:
+        case NODE_UNTIL:
+            while(1){
+                runList(script, node->first);
+                if(scriptControl != CONTROL_NONE && endLoop()){
+                    break;
+                }
+                if((exitStatus == 0) != (node->type == NODE_WHILE)){
+                    break;
+                }
+                runList(script, node->second);
+                status = exitStatus;
+                if(endLoop()){
+                    break;
+                }
+            }
+            exitStatus = status;
+            break;
+        case NODE_FOR:
+            runFor(script, node);
+            break;
+        case NODE_GROUP:
+            runList(script, node->first);
+            break;
+        case NODE_FUNCTION:
+            defineFunction(scriptFunctions, script->strings + node->text, script, node->first);
+            exitStatus = 0;
+            break;
+    }
+}
+
+/*
+// Run a list of nodes linked by next. It stops early when a break, continue or return is pending.
+*/
+void runList(struct script* script, int node){
+    for(; node != -1 && scriptControl == CONTROL_NONE; node = script->nodes[node].next){
+        runNode(script, node);
+    }
+}
+
+/*
+// Run a whole script, then drop any break, continue or return that was left pending outside a loop or function
+*/
+void runScript(struct script* script){
+    runList(script, script->root);
+    scriptControl = CONTROL_NONE;
+}
+
+/*
+// break: leave the innermost loop
+*/
+void smallsh_break(struct command* smallsh_command){
+    scriptControl = CONTROL_BREAK;
+}
+
+/*
+// continue: start the next iteration of the innermost loop
+*/
+void smallsh_continue(struct command* smallsh_command){
+    scriptControl = CONTROL_CONTINUE;
+}
+
+/*
+// return [n]: leave the function that is running, with status n or the status of the last command
+*/
+void smallsh_return(struct command* smallsh_command){
+    if(smallsh_command->args[1] != NULL){
+        exitStatus = atoi(smallsh_command->args[1]);
+    }
+    scriptControl = CONTROL_RETURN;
+}
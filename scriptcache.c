@@ -0,0 +1,230 @@
+/***************************************
+ * Smallsh: on-disk cache of parsed scripts
+ * A cache file holds a header, the script's path, its nodes and its strings. Nodes refer to each other and to
+ * strings by index, so a cache file is used where it is mapped without being parsed or copied.
+***************************************/
+#include "smallsh.h"
+
+#define SCRIPT_CACHE_MAGIC "SMSHAST"
+#define SCRIPT_CACHE_VERSION 1
+
+/*
+// Start of a cache file. The script's path follows it, padded to a multiple of 8 bytes, then the nodes, then the strings.
+*/
+struct scriptCacheHeader{
+    char magic[8];
+    int version;
+    int numNodes;
+    int root;
+    int pathLen;
+    long long mtimeSec;         // modification time and size of the script when it was parsed
+    long long mtimeNsec;
+    long long size;
+    long long stringsLen;
+};
+
+static size_t padded(size_t len){
+    return (len + 7) & ~(size_t)7;
+}
+
+/*
+// Build the name of the cache file for the script at path, which must be absolute.
+// The name is a hash of the path, the path itself is stored in the file to detect collisions.
+*/
+static char* cacheFileName(char* dir, char* path){
+    size_t len = strlen(dir) + 32;
+    char* name = malloc(len);
+
+    snprintf(name, len, "%s/%08x.ast", dir, hashString(path));
+    return name;
+}
+
+/*
+// Return 1 if index is -1 or the index of one of count items
+*/
+static int validIndex(int index, long long count){
+    return index >= -1 && index < count;
+}
+
+/*
+// Count a reference to node in references. Returns 0 if node was already referenced, so the nodes are not a tree.
+*/
+static int addReference(char* references, int node){
+    if(node == -1){
+        return 1;
+    }
+    return references[node]++ == 0;
+}
+
+/*
+// Check that the nodes and strings of a cache file form a script that can be run:
+//  - every node has a known type, and a text if its type needs one
+//  - every link and the root is a node, and every text is an offset into strings, which end with a '\0'
+//  - no node is linked to twice and the root not at all, so following the links always ends
+*/
+static int validCachedScript(struct scriptNode* nodes, int numNodes, int root, char* strings, long long stringsLen){
+    char* references;
+    struct scriptNode* node;
+    int valid = validIndex(root, numNodes) && (stringsLen == 0 || strings[stringsLen - 1] == '\0');
+    int i;
+
+    references = calloc(numNodes + 1, 1);
+    valid = valid && addReference(references, root);
+    for(i = 0; valid && i < numNodes; i++){
+        node = &nodes[i];
+        valid = node->type >= NODE_COMMAND && node->type <= NODE_FUNCTION
+                && validIndex(node->text, stringsLen) && validIndex(node->words, stringsLen)
+                && (node->text != -1 || (node->type != NODE_COMMAND && node->type != NODE_FOR
+                                         && node->type != NODE_FUNCTION))
+                && validIndex(node->first, numNodes) && validIndex(node->second, numNodes)
+                && validIndex(node->third, numNodes) && validIndex(node->next, numNodes);
+    }
+    for(i = 0; valid && i < numNodes; i++){
+        node = &nodes[i];
+        valid = addReference(references, node->first) && addReference(references, node->second)
+                && addReference(references, node->third) && addReference(references, node->next);
+    }
+    free(references);
+    return valid;
+}
+
+/*
+// Load the parsed form of a script from the cache in dir.
+// Returns NULL if there is no cache file for it, if the script changed since the file was written, or if the
+// file is damaged.
+*/
+struct script* loadCachedScript(char* dir, char* path, struct stat* info){
+    struct scriptCacheHeader* header;
+    struct script* script;
+    struct stat cacheInfo;
+    char* realPath = realpath(path, NULL);
+    char* name;
+    char* data;
+    size_t nodesStart;
+    int fd;
+
+    if(realPath == NULL){
+        return NULL;
+    }
+    name = cacheFileName(dir, realPath);
+    fd = open(name, O_RDONLY | O_CLOEXEC);
+    free(name);
+    if(fd == -1){
+        free(realPath);
+        return NULL;
+    }
+    if(fstat(fd, &cacheInfo) == -1 || cacheInfo.st_size < (off_t)sizeof(struct scriptCacheHeader)){
+        close(fd);
+        free(realPath);
+        return NULL;
+    }
+    data = mmap(NULL, cacheInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        free(realPath);
+        return NULL;
+    }
+
+    // the file must be complete and belong to this version of the script
+    header = (struct scriptCacheHeader*)data;
+    nodesStart = sizeof(struct scriptCacheHeader) + padded(header->pathLen);
+    if(memcmp(header->magic, SCRIPT_CACHE_MAGIC, sizeof(header->magic)) != 0
+       || header->version != SCRIPT_CACHE_VERSION
+       || header->mtimeSec != (long long)info->st_mtim.tv_sec
+       || header->mtimeNsec != (long long)info->st_mtim.tv_nsec
+       || header->size != (long long)info->st_size
+       || header->pathLen != (int)strlen(realPath)
+       || header->numNodes < 0 || header->stringsLen < 0
+       || nodesStart + header->numNodes * sizeof(struct scriptNode) + header->stringsLen != (size_t)cacheInfo.st_size
+       || memcmp(data + sizeof(struct scriptCacheHeader), realPath, header->pathLen) != 0
+       || !validCachedScript((struct scriptNode*)(data + nodesStart), header->numNodes, header->root,
+                             data + nodesStart + header->numNodes * sizeof(struct scriptNode), header->stringsLen)){
+        munmap(data, cacheInfo.st_size);
+        free(realPath);
+        return NULL;
+    }
+    free(realPath);
+
+    script = calloc(1, sizeof(struct script));
+    script->nodes = (struct scriptNode*)(data + nodesStart);
+    script->numNodes = header->numNodes;
+    script->strings = data + nodesStart + header->numNodes * sizeof(struct scriptNode);
+    script->stringsLen = header->stringsLen;
+    script->root = header->root;
+    script->mapping = data;
+    script->mappingLen = cacheInfo.st_size;
+    script->references = 1;
+    return script;
+}
+
+/*
+// Write all len bytes of data to fd. Returns -1 on an error.
+*/
+static int writeAll(int fd, const void* data, size_t len){
+    const char* next = data;
+    ssize_t written;
+
+    while(len > 0){
+        written = write(fd, next, len);
+        if(written == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        next += written;
+        len -= written;
+    }
+    return 0;
+}
+
+/*
+// Store the parsed form of a script in the cache in dir, creating dir if needed.
+// The file is written under a temporary name and renamed into place, so scripts started at the same time
+// never read a partial file. The cache is only an optimization, so errors are ignored.
+*/
+void saveCachedScript(char* dir, char* path, struct stat* info, struct script* script){
+    struct scriptCacheHeader header = {0};
+    char zeros[8] = {0};
+    char* realPath = realpath(path, NULL);
+    char* name;
+    char* tempName;
+    size_t tempLen;
+    int fd;
+    int failed;
+
+    if(realPath == NULL){
+        return;
+    }
+    mkdir(dir, 0700);
+    name = cacheFileName(dir, realPath);
+    tempLen = strlen(name) + 32;
+    tempName = malloc(tempLen);
+    snprintf(tempName, tempLen, "%s.%d", name, getpid());
+
+    fd = open(tempName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(fd != -1){
+        memcpy(header.magic, SCRIPT_CACHE_MAGIC, sizeof(header.magic));
+        header.version = SCRIPT_CACHE_VERSION;
+        header.numNodes = script->numNodes;
+        header.root = script->root;
+        header.pathLen = strlen(realPath);
+        header.mtimeSec = info->st_mtim.tv_sec;
+        header.mtimeNsec = info->st_mtim.tv_nsec;
+        header.size = info->st_size;
+        header.stringsLen = script->stringsLen;
+
+        failed = writeAll(fd, &header, sizeof(header)) == -1
+                 || writeAll(fd, realPath, header.pathLen) == -1
+                 || writeAll(fd, zeros, padded(header.pathLen) - header.pathLen) == -1
+                 || writeAll(fd, script->nodes, script->numNodes * sizeof(struct scriptNode)) == -1
+                 || writeAll(fd, script->strings, script->stringsLen) == -1;
+        close(fd);
+        if(failed || rename(tempName, name) == -1){
+            unlink(tempName);
+        }
+    }
+    free(tempName);
+    free(name);
+    free(realPath);
+}
@@ -0,0 +1,858 @@
+/***************************************
+ * Smallsh: server mode and its client
+ * smallsh --serve path accepts connections on a Unix socket. Each request is a batch of commands that is run in a
+ * worker forked from the server, so it starts with smallsh already initialized, in the session's working directory
+ * and with the session's last exit status as $?. The worker's stdout and stderr are streamed back to the client,
+ * followed by the batch's exit status. Every session is multiplexed in one epoll loop, with at most limit
+ * workers running at once; requests beyond that wait their turn in arrival order.
+ *
+ * Messages in both directions are frames: a type byte, a 4 byte big-endian length and that many bytes of payload.
+***************************************/
+#include "smallsh.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <limits.h>
+
+#define FRAME_COMMANDS 'c'          // client to server: a batch of commands, one or more lines
+#define FRAME_STDOUT 'o'            // server to client: output the batch wrote to stdout
+#define FRAME_STDERR 'e'            // server to client: output the batch wrote to stderr
+#define FRAME_STATUS 'x'            // server to client: the batch finished, the payload is its exit status in decimal
+#define FRAME_HEADER_SIZE 5
+#define MAX_REQUEST_SIZE (1 << 24)  // larger requests close the session
+#define OUTPUT_LIMIT (1 << 20)      // stop reading a worker's output while this much is waiting to be sent to its client
+
+#define WATCH_LISTEN 0              // kinds of descriptors in the epoll set, stored in the low bits of the event data
+#define WATCH_SIGNALS 1
+#define WATCH_CLIENT 2
+#define WATCH_STDOUT 3
+#define WATCH_STDERR 4
+#define WATCH_STATE 5
+
+/*
+// A client connection and the worker running its current request
+*/
+struct session{
+    int fd;                     // client socket, -1 once the client is gone or the slot is free
+    int inUse;
+    int nextFree;               // next free slot when this one is free
+    int nextWaiting;            // next session waiting for a worker, -1 at the end of the queue
+    int waiting;
+    char* cwd;                  // working directory that the next request starts in
+    int status;                 // exit status of the last request, $? in the next one
+    char* in;                   // bytes received from the client that have not been handled
+    size_t inLen;
+    size_t inCapacity;
+    char* out;                  // frames waiting to be sent to the client, starting at outStart
+    size_t outStart;
+    size_t outLen;
+    size_t outCapacity;
+    int wantWrite;              // the client socket is watched for room to write
+    pid_t worker;               // pid of the worker running the current request, 0 when there is none
+    int outFd;                  // read ends of the worker's stdout, stderr and state pipes, -1 once closed
+    int errFd;
+    int stateFd;
+    int throttled;              // the worker's stdout and stderr are not watched until the client catches up
+    int reaped;
+    int workerStatus;           // wait status of the worker once reaped
+    char state[PATH_MAX + 1];   // working directory reported by the worker when it exits
+    size_t stateLen;
+};
+
+/*
+// State of the server
+*/
+struct server{
+    struct session* sessions;
+    int capacity;
+    int freeHead;               // first free slot, -1 if there is none
+    int waitHead;               // queue of sessions waiting for a worker, -1 when empty
+    int waitTail;
+    int listenFd;
+    int epollFd;
+    int limit;                  // most workers running at once
+    int running;
+    struct pidMap* workers;     // maps the pid of each worker to its session's slot
+};
+
+static int workerStateFd = -1;      // in a worker, the write end of its state pipe
+static pid_t workerPid = 0;         // in a worker, its pid, so processes forked by it do not report a state
+
+/*
+// Store a frame header for a payload of len bytes
+*/
+static void frameHeader(char* header, char type, size_t len){
+    header[0] = type;
+    header[1] = (len >> 24) & 0xff;
+    header[2] = (len >> 16) & 0xff;
+    header[3] = (len >> 8) & 0xff;
+    header[4] = len & 0xff;
+}
+
+/*
+// Read the payload length from a frame header
+*/
+static size_t frameLength(const char* header){
+    const unsigned char* bytes = (const unsigned char*)header;
+
+    return ((size_t)bytes[1] << 24) | ((size_t)bytes[2] << 16) | ((size_t)bytes[3] << 8) | bytes[4];
+}
+
+/*
+// Add an epoll watch for fd, tagged with its kind and session slot
+*/
+static void watchFd(struct server* server, int fd, int kind, int slot, int events){
+    struct epoll_event event = {0};
+
+    event.events = events;
+    event.data.u64 = ((uint64_t)slot << 3) | kind;
+    epoll_ctl(server->epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/*
+// Change the events watched for fd
+*/
+static void changeWatch(struct server* server, int fd, int kind, int slot, int events){
+    struct epoll_event event = {0};
+
+    event.events = events;
+    event.data.u64 = ((uint64_t)slot << 3) | kind;
+    epoll_ctl(server->epollFd, EPOLL_CTL_MOD, fd, &event);
+}
+
+/*
+// Close fd, which also removes it from the epoll set, and set it to -1
+*/
+static void closeWatched(int* fd){
+    if(*fd != -1){
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+/*
+// Stop or resume reading a worker's output depending on how much of it is waiting to be sent
+*/
+static void throttleWorker(struct server* server, int slot){
+    struct session* session = &server->sessions[slot];
+    int throttle = session->outLen - session->outStart > OUTPUT_LIMIT;
+
+    if(throttle == session->throttled){
+        return;
+    }
+    session->throttled = throttle;
+    if(session->outFd != -1){
+        changeWatch(server, session->outFd, WATCH_STDOUT, slot, throttle ? 0 : EPOLLIN);
+    }
+    if(session->errFd != -1){
+        changeWatch(server, session->errFd, WATCH_STDERR, slot, throttle ? 0 : EPOLLIN);
+    }
+}
+
+/*
+// Send as much of the session's pending frames as the client socket takes without blocking.
+// The socket is watched for room to write while anything is left.
+*/
+static void flushSession(struct server* server, int slot){
+    struct session* session = &server->sessions[slot];
+    ssize_t sent;
+    int wantWrite;
+
+    while(session->fd != -1 && session->outStart < session->outLen){
+        sent = send(session->fd, session->out + session->outStart, session->outLen - session->outStart, MSG_NOSIGNAL);
+        if(sent == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            if(errno != EAGAIN){
+                // the client is gone, drop what it did not read
+                closeWatched(&session->fd);
+                session->outStart = session->outLen;
+            }
+            break;
+        }
+        session->outStart += sent;
+    }
+    if(session->outStart == session->outLen){
+        session->outStart = 0;
+        session->outLen = 0;
+    }
+
+    wantWrite = session->outStart < session->outLen;
+    if(session->fd != -1 && wantWrite != session->wantWrite){
+        changeWatch(server, session->fd, WATCH_CLIENT, slot, wantWrite ? EPOLLIN | EPOLLOUT : EPOLLIN);
+        session->wantWrite = wantWrite;
+    }
+    throttleWorker(server, slot);
+}
+
+/*
+// Queue a frame for the session's client. Frames for a client that is gone are dropped.
+*/
+static void queueFrame(struct session* session, char type, const char* data, size_t len){
+    if(session->fd == -1){
+        return;
+    }
+    if(session->outStart > 0 && session->outLen + FRAME_HEADER_SIZE + len > session->outCapacity){
+        memmove(session->out, session->out + session->outStart, session->outLen - session->outStart);
+        session->outLen -= session->outStart;
+        session->outStart = 0;
+    }
+    while(session->outLen + FRAME_HEADER_SIZE + len > session->outCapacity){
+        session->outCapacity = session->outCapacity == 0 ? 1 << 16 : session->outCapacity * 2;
+        session->out = realloc(session->out, session->outCapacity);
+    }
+    frameHeader(session->out + session->outLen, type, len);
+    memcpy(session->out + session->outLen + FRAME_HEADER_SIZE, data, len);
+    session->outLen += FRAME_HEADER_SIZE + len;
+}
+
+/*
+// Read what is available from a worker's stdout or stderr pipe and queue it for the client.
+// If drain is set, read until the pipe is empty. The pipe is closed at its end.
+*/
+static void readWorkerOutput(struct server* server, int slot, int* fd, char type, int drain){
+    static char buffer[1 << 16];
+    struct session* session = &server->sessions[slot];
+    ssize_t numRead;
+
+    while(*fd != -1){
+        numRead = read(*fd, buffer, sizeof(buffer));
+        if(numRead == -1 && errno == EINTR){
+            continue;
+        }
+        if(numRead == -1 && errno == EAGAIN){
+            break;
+        }
+        if(numRead <= 0){
+            closeWatched(fd);
+            break;
+        }
+        queueFrame(session, type, buffer, numRead);
+        if(!drain){
+            break;
+        }
+    }
+}
+
+/*
+// Report the working directory of a worker to the server when it exits, however it exits
+*/
+static void reportWorkerState(){
+    char cwd[PATH_MAX];
+    ssize_t len;
+
+    if(getpid() != workerPid || getcwd(cwd, sizeof(cwd)) == NULL){
+        return;
+    }
+    len = strlen(cwd);
+    while(len > 0 && write(workerStateFd, cwd, len) == -1 && errno == EINTR);
+}
+
+static void freeSession(struct server* server, int slot);
+
+/*
+// Answer a request whose worker could not be started with the error on stderr and an exit status of 1,
+// and close the pipes already opened for it. The server keeps running.
+*/
+static void failRequest(struct server* server, int slot, char* call, int* pipes, int numPipes){
+    struct session* session = &server->sessions[slot];
+    char message[128];
+    int err = errno;
+    int len;
+
+    while(numPipes > 0){
+        close(pipes[--numPipes]);
+    }
+    len = snprintf(message, sizeof(message), "smallsh: %s: %s\n", call, strerror(err));
+    fprintf(stderr, "%s", message);
+    fflush(stderr);
+    queueFrame(session, FRAME_STDERR, message, len);
+    session->status = 1;
+    queueFrame(session, FRAME_STATUS, "1", 1);
+    flushSession(server, slot);
+    if(session->fd == -1){
+        freeSession(server, slot);
+    }
+}
+
+/*
+// Start a worker for the request at the front of the session's input.
+// The worker is a copy of the server that runs the request as a batch script in the session's working directory,
+// with stdin from /dev/null and stdout and stderr connected to pipes that the server reads.
+// If the worker cannot be started the request is answered with an error, see failRequest().
+*/
+static void startWorker(struct server* server, int slot){
+    struct session* session = &server->sessions[slot];
+    size_t len = frameLength(session->in);
+    char* commands = malloc(len + 1);
+    int pipes[6];               // read and write ends of the stdout, stderr and state pipes
+    int* outPipe = pipes;
+    int* errPipe = pipes + 2;
+    int* statePipe = pipes + 4;
+    int devNull;
+    int i;
+    pid_t pid;
+
+    memcpy(commands, session->in + FRAME_HEADER_SIZE, len);
+    commands[len] = '\0';
+    session->inLen -= FRAME_HEADER_SIZE + len;
+    memmove(session->in, session->in + FRAME_HEADER_SIZE + len, session->inLen);
+
+    for(i = 0; i < 6; i += 2){
+        if(pipe2(pipes + i, O_CLOEXEC) == -1){
+            free(commands);
+            failRequest(server, slot, "pipe2()", pipes, i);
+            return;
+        }
+    }
+
+    // flush every stream, so the worker does not write out what the server has buffered again
+    fflush(NULL);
+    pid = fork();
+    if(pid == -1){
+        free(commands);
+        failRequest(server, slot, "fork()", pipes, 6);
+        return;
+    }
+    if(pid == 0){
+        // the worker keeps nothing of the server except its own pipes
+        devNull = open("/dev/null", O_RDONLY);
+        dup2(devNull, STDIN_FILENO);
+        dup2(outPipe[1], STDOUT_FILENO);
+        dup2(errPipe[1], STDERR_FILENO);
+        close(devNull);
+        close(outPipe[0]);
+        close(errPipe[0]);
+        close(statePipe[0]);
+        close(server->listenFd);
+        close(server->epollFd);
+        for(i = 0; i < server->capacity; i++){
+            if(server->sessions[i].inUse){
+                closeWatched(&server->sessions[i].fd);
+                closeWatched(&server->sessions[i].outFd);
+                closeWatched(&server->sessions[i].errFd);
+                closeWatched(&server->sessions[i].stateFd);
+            }
+        }
+
+        workerStateFd = statePipe[1];
+        workerPid = getpid();
+        atexit(reportWorkerState);
+        if(chdir(session->cwd) == -1){
+            perror(session->cwd);
+        }
+        exitStatus = session->status;
+        batch = openCommandString(commands);
+        free(commands);
+        runBatch();
+    }
+
+    free(commands);
+    close(outPipe[1]);
+    close(errPipe[1]);
+    close(statePipe[1]);
+    session->worker = pid;
+    session->outFd = outPipe[0];
+    session->errFd = errPipe[0];
+    session->stateFd = statePipe[0];
+    session->reaped = 0;
+    session->stateLen = 0;
+    session->throttled = 0;
+    fcntl(session->outFd, F_SETFL, O_NONBLOCK);
+    fcntl(session->errFd, F_SETFL, O_NONBLOCK);
+    fcntl(session->stateFd, F_SETFL, O_NONBLOCK);
+    watchFd(server, session->outFd, WATCH_STDOUT, slot, EPOLLIN);
+    watchFd(server, session->errFd, WATCH_STDERR, slot, EPOLLIN);
+    watchFd(server, session->stateFd, WATCH_STATE, slot, EPOLLIN);
+    pidMapInsert(server->workers, pid, slot);
+    server->running++;
+    throttleWorker(server, slot);
+}
+
+/*
+// Free a session's slot once its client is gone and it has no worker
+*/
+static void freeSession(struct server* server, int slot){
+    struct session* session = &server->sessions[slot];
+
+    closeWatched(&session->fd);
+    free(session->cwd);
+    free(session->in);
+    free(session->out);
+    memset(session, 0, sizeof(struct session));
+    session->fd = -1;
+    session->outFd = -1;
+    session->errFd = -1;
+    session->stateFd = -1;
+    session->nextFree = server->freeHead;
+    server->freeHead = slot;
+}
+
+/*
+// Start the session's next request if a complete one has arrived, or queue the session if every worker is busy.
+// A request whose worker could not be started has been answered with an error, so the one after it is tried.
+// A malformed or oversized request ends the session.
+*/
+static void nextRequest(struct server* server, int slot){
+    struct session* session = &server->sessions[slot];
+
+    while(1){
+        if(session->worker != 0 || session->waiting || session->fd == -1 || session->inLen < FRAME_HEADER_SIZE){
+            return;
+        }
+        if(session->in[0] != FRAME_COMMANDS || frameLength(session->in) > MAX_REQUEST_SIZE){
+            freeSession(server, slot);
+            return;
+        }
+        if(session->inLen < FRAME_HEADER_SIZE + frameLength(session->in)){
+            return;
+        }
+        if(server->running >= server->limit){
+            break;
+        }
+        startWorker(server, slot);
+    }
+    session->waiting = 1;
+    session->nextWaiting = -1;
+    if(server->waitHead == -1){
+        server->waitHead = slot;
+    } else {
+        server->sessions[server->waitTail].nextWaiting = slot;
+    }
+    server->waitTail = slot;
+}
+
+/*
+// Start the requests of waiting sessions while there are free workers
+*/
+static void startWaiting(struct server* server){
+    int slot;
+
+    while(server->running < server->limit && server->waitHead != -1){
+        slot = server->waitHead;
+        server->waitHead = server->sessions[slot].nextWaiting;
+        server->sessions[slot].waiting = 0;
+        if(server->sessions[slot].fd == -1){
+            // the client left while it waited
+            freeSession(server, slot);
+        } else {
+            startWorker(server, slot);
+            nextRequest(server, slot);
+        }
+    }
+}
+
+/*
+// Finish a request once its worker has been reaped and has closed its state pipe:
+// send the rest of its output and its exit status, and keep its working directory and status for the session.
+*/
+static void finishWorker(struct server* server, int slot){
+    struct session* session = &server->sessions[slot];
+    char statusText[16];
+    int len;
+
+    if(!session->reaped || session->stateFd != -1){
+        return;
+    }
+    // processes the batch left in the background may hold the pipes open, only take what is already there
+    readWorkerOutput(server, slot, &session->outFd, FRAME_STDOUT, 1);
+    readWorkerOutput(server, slot, &session->errFd, FRAME_STDERR, 1);
+    closeWatched(&session->outFd);
+    closeWatched(&session->errFd);
+
+    if(session->stateLen > 0){
+        session->state[session->stateLen] = '\0';
+        free(session->cwd);
+        session->cwd = strdup(session->state);
+    }
+    session->status = exitCode(session->workerStatus);
+    len = snprintf(statusText, sizeof(statusText), "%d", session->status);
+    queueFrame(session, FRAME_STATUS, statusText, len);
+    session->worker = 0;
+    server->running--;
+
+    flushSession(server, slot);
+    if(session->fd == -1){
+        freeSession(server, slot);
+    } else {
+        nextRequest(server, slot);
+    }
+    startWaiting(server);
+}
+
+/*
+// Read the working directory a worker reports when it exits
+*/
+static void readWorkerState(struct server* server, int slot){
+    struct session* session = &server->sessions[slot];
+    ssize_t numRead;
+
+    while(session->stateFd != -1){
+        numRead = read(session->stateFd, session->state + session->stateLen, PATH_MAX - session->stateLen);
+        if(numRead == -1 && errno == EINTR){
+            continue;
+        }
+        if(numRead == -1 && errno == EAGAIN){
+            return;
+        }
+        if(numRead <= 0 || session->stateLen + numRead == PATH_MAX){
+            closeWatched(&session->stateFd);
+            break;
+        }
+        session->stateLen += numRead;
+    }
+    finishWorker(server, slot);
+}
+
+/*
+// Reap the workers that exited
+*/
+static void reapWorkers(struct server* server){
+    int childStatus;
+    int slot;
+    pid_t childPid;
+    struct rusage usage;
+
+    while((childPid = wait4(-1, &childStatus, WNOHANG, &usage)) > 0){
+        statsReaped(commandStats, childPid, childStatus, &usage);
+        slot = pidMapRemove(server->workers, childPid);
+        if(slot != -1){
+            server->sessions[slot].reaped = 1;
+            server->sessions[slot].workerStatus = childStatus;
+            finishWorker(server, slot);
+        }
+    }
+}
+
+/*
+// Accept every pending connection as a new session that starts in the server's working directory
+*/
+static void acceptSessions(struct server* server, char* cwd){
+    struct session* session;
+    int fd;
+    int slot;
+    int i;
+
+    while((fd = accept4(server->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1){
+        if(server->freeHead == -1){
+            server->sessions = realloc(server->sessions, server->capacity * 2 * sizeof(struct session));
+            for(i = server->capacity; i < server->capacity * 2; i++){
+                memset(&server->sessions[i], 0, sizeof(struct session));
+                server->sessions[i].fd = -1;
+                server->sessions[i].nextFree = i + 1 < server->capacity * 2 ? i + 1 : -1;
+            }
+            server->freeHead = server->capacity;
+            server->capacity *= 2;
+        }
+        slot = server->freeHead;
+        session = &server->sessions[slot];
+        server->freeHead = session->nextFree;
+
+        session->inUse = 1;
+        session->fd = fd;
+        session->cwd = strdup(cwd);
+        session->outFd = -1;
+        session->errFd = -1;
+        session->stateFd = -1;
+        watchFd(server, fd, WATCH_CLIENT, slot, EPOLLIN);
+    }
+}
+
+/*
+// Handle the client side of a session: read requests, and send pending frames when there is room
+*/
+static void handleClient(struct server* server, int slot, int events){
+    struct session* session = &server->sessions[slot];
+    ssize_t numRead;
+
+    if(session->fd == -1){
+        return;
+    }
+    if(events & EPOLLOUT){
+        flushSession(server, slot);
+        if(session->fd == -1){
+            if(session->worker == 0 && !session->waiting){
+                freeSession(server, slot);
+            }
+            return;
+        }
+    }
+    if(!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))){
+        return;
+    }
+    while(1){
+        if(session->inCapacity - session->inLen < 4096){
+            session->inCapacity = session->inCapacity == 0 ? 1 << 16 : session->inCapacity * 2;
+            session->in = realloc(session->in, session->inCapacity);
+        }
+        numRead = read(session->fd, session->in + session->inLen, session->inCapacity - session->inLen);
+        if(numRead == -1 && errno == EINTR){
+            continue;
+        }
+        if(numRead == -1 && errno == EAGAIN){
+            break;
+        }
+        if(numRead <= 0){
+            // the client is gone, its request still running finishes without it
+            closeWatched(&session->fd);
+            if(session->worker == 0 && !session->waiting){
+                freeSession(server, slot);
+            }
+            return;
+        }
+        session->inLen += numRead;
+    }
+    nextRequest(server, slot);
+}
+
+/*
+// Fill in the address of the Unix socket at path. Returns 0, or -1 and prints an error if path does not fit.
+*/
+static int socketAddress(char* path, struct sockaddr_un* address){
+    if(strlen(path) >= sizeof(address->sun_path)){
+        fprintf(stderr, "%s: socket path is too long\n", path);
+        return -1;
+    }
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+/*
+// Create a Unix socket listening at path. A socket left there by a server that is no longer running is replaced.
+// Returns the socket, or -1 and prints an error.
+*/
+static int listenSocket(char* path){
+    struct sockaddr_un address = {0};
+    int fd;
+    int probe;
+    int bound;
+
+    if(socketAddress(path, &address) == -1){
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd == -1){
+        perror(path);
+        return -1;
+    }
+    bound = bind(fd, (struct sockaddr*)&address, sizeof(address));
+    if(bound == -1 && errno == EADDRINUSE){
+        // nothing accepts connections on a stale socket. If the probe cannot be created, the error is reported below.
+        probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(probe != -1){
+            if(connect(probe, (struct sockaddr*)&address, sizeof(address)) == -1 && errno == ECONNREFUSED){
+                unlink(path);
+                bound = bind(fd, (struct sockaddr*)&address, sizeof(address));
+            } else {
+                errno = EADDRINUSE;
+            }
+            close(probe);
+        }
+    }
+    if(bound == -1 || listen(fd, SOMAXCONN) == -1){
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+// Serve sessions on the Unix socket at path with at most limit requests running at once.
+// Runs until smallsh is killed. Returns 1 if the socket cannot be created.
+*/
+int serve(char* path, int limit){
+    struct server server = {0};
+    struct epoll_event events[64];
+    char* cwd = getcwd(NULL, 0);
+    int numEvents;
+    int slot;
+    int kind;
+    int i;
+
+    server.listenFd = listenSocket(path);
+    if(server.listenFd == -1 || cwd == NULL){
+        free(cwd);
+        return 1;
+    }
+    server.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    server.limit = limit;
+    server.waitHead = -1;
+    server.waitTail = -1;
+    server.workers = initPidMap();
+    server.capacity = 16;
+    server.sessions = calloc(server.capacity, sizeof(struct session));
+    for(i = 0; i < server.capacity; i++){
+        server.sessions[i].fd = -1;
+        server.sessions[i].nextFree = i + 1 < server.capacity ? i + 1 : -1;
+    }
+    server.freeHead = 0;
+    watchFd(&server, server.listenFd, WATCH_LISTEN, 0, EPOLLIN);
+    watchFd(&server, signalEvents(), WATCH_SIGNALS, 0, EPOLLIN);
+
+    while(1){
+        numEvents = epoll_wait(server.epollFd, events, 64, -1);
+        if(numEvents == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            perror("epoll_wait()");
+            return 1;
+        }
+        for(i = 0; i < numEvents; i++){
+            kind = events[i].data.u64 & 7;
+            slot = events[i].data.u64 >> 3;
+            if(kind == WATCH_LISTEN){
+                acceptSessions(&server, cwd);
+            } else if(kind == WATCH_SIGNALS){
+                handleSignals(0);
+                reapWorkers(&server);
+            } else if(!server.sessions[slot].inUse){
+                // the session ended earlier in this batch of events
+                continue;
+            } else if(kind == WATCH_CLIENT){
+                handleClient(&server, slot, events[i].events);
+            } else if(kind == WATCH_STDOUT){
+                readWorkerOutput(&server, slot, &server.sessions[slot].outFd, FRAME_STDOUT, 0);
+                flushSession(&server, slot);
+            } else if(kind == WATCH_STDERR){
+                readWorkerOutput(&server, slot, &server.sessions[slot].errFd, FRAME_STDERR, 0);
+                flushSession(&server, slot);
+            } else if(kind == WATCH_STATE){
+                readWorkerState(&server, slot);
+            }
+        }
+    }
+}
+
+/*
+// Write all len bytes of data to fd. Returns -1 on an error.
+*/
+static int sendAll(int fd, const char* data, size_t len){
+    ssize_t sent;
+
+    while(len > 0){
+        sent = send(fd, data, len, MSG_NOSIGNAL);
+        if(sent == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+/*
+// Read exactly len bytes from fd. Returns -1 on an error or if the connection closes first.
+*/
+static int receiveAll(int fd, char* data, size_t len){
+    ssize_t numRead;
+
+    while(len > 0){
+        numRead = read(fd, data, len);
+        if(numRead == -1 && errno == EINTR){
+            continue;
+        }
+        if(numRead <= 0){
+            return -1;
+        }
+        data += numRead;
+        len -= numRead;
+    }
+    return 0;
+}
+
+/*
+// Connect to a server listening at path. Returns the socket, or -1 and prints an error.
+*/
+int connectServer(char* path){
+    struct sockaddr_un address = {0};
+    int fd;
+
+    if(socketAddress(path, &address) == -1){
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1){
+        perror(path);
+        return -1;
+    }
+    if(connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1){
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+// Send a batch of commands to the server on fd and copy its output to stdout and stderr until it finishes.
+// Returns the batch's exit status, or -1 if the connection failed.
+*/
+int runRequest(int fd, char* commands, size_t len){
+    char header[FRAME_HEADER_SIZE];
+    char* payload = NULL;
+    size_t payloadLen;
+    int status = -1;
+
+    frameHeader(header, FRAME_COMMANDS, len);
+    if(sendAll(fd, header, FRAME_HEADER_SIZE) == -1 || sendAll(fd, commands, len) == -1){
+        return -1;
+    }
+    while(receiveAll(fd, header, FRAME_HEADER_SIZE) == 0){
+        payloadLen = frameLength(header);
+        payload = realloc(payload, payloadLen + 1);
+        if(receiveAll(fd, payload, payloadLen) == -1){
+            break;
+        }
+        if(header[0] == FRAME_STDOUT){
+            fwrite(payload, 1, payloadLen, stdout);
+        } else if(header[0] == FRAME_STDERR){
+            fflush(stdout);
+            fwrite(payload, 1, payloadLen, stderr);
+        } else if(header[0] == FRAME_STATUS){
+            payload[payloadLen] = '\0';
+            status = atoi(payload);
+            break;
+        }
+    }
+    fflush(stdout);
+    free(payload);
+    return status;
+}
+
+/*
+// Run commands on the server at path: the -c commands or script in input as one batch,
+// or each line of stdin as a batch of its own. Returns the exit status of the last batch.
+*/
+int runClient(char* path, struct batchInput* input){
+    char* line = NULL;
+    size_t len = 0;
+    ssize_t numRead;
+    int status = 0;
+    int fd = connectServer(path);
+
+    if(fd == -1){
+        return 1;
+    }
+    if(input != NULL){
+        status = runRequest(fd, input->data, input->len);
+    } else {
+        while(status != -1 && (numRead = getline(&line, &len, stdin)) != -1){
+            status = runRequest(fd, line, numRead);
+        }
+        free(line);
+    }
+    close(fd);
+    if(status == -1){
+        fprintf(stderr, "%s: connection closed\n", path);
+        return 1;
+    }
+    return status;
+}
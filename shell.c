@@ -0,0 +1,263 @@
+/***************************************
+ * Smallsh: shell state and the main loop
+***************************************/
+#include "smallsh.h"
+
+struct batchInput* batch = NULL;    // input for batch mode, NULL when reading commands from stdin
+struct arena* commandArena;         // memory for the command line currently being parsed and run
+struct pathCache* commandPaths;     // absolute paths of the commands that have been run
+struct statsTable* commandStats;    // resource usage of every command that has been run
+struct jobTable* backgroundJobs;    // table of background processes that have not been reaped yet
+int runBackground = 1;              // If runBackground is set to 1, background processes can be run. If 0, they are restricted to foreground.
+int exitStatus = 0;                 // exit code of the last foreground command, 128 + signal number if it was killed by a signal
+pid_t lastBackgroundPid = 0;        // pid of the last background process, expanded by $!
+int launchMode = LAUNCH_SPAWN;      // backend used to start external commands, selected at startup
+int relayPipes = 0;                 // If relayPipes is set to 1, smallsh moves the data between foreground pipeline stages with splice()
+struct functionTable* scriptFunctions;  // functions defined by scripts and at the prompt
+struct script* commandScript;       // the script being run, or the parsed form of the last line read at the prompt
+int scriptControl = CONTROL_NONE;   // pending break, continue or return, one of the CONTROL_ constants
+int foregroundInterrupted = 0;      // set when a foreground command is killed by SIGINT or smallsh reads a SIGINT while waiting for it
+static char* defaultArgs[] = {"smallsh", NULL};
+char** positionalArgs = defaultArgs;    // $0, $1, ... terminated by NULL
+int positionalCount = 0;            // number of positional parameters after $0, expanded by $#
+char* scriptCacheDir = NULL;        // directory that parsed scripts are cached in, NULL if caching is off
+struct launchPolicy backgroundPolicy;   // policy that background jobs are launched with, set by bgpolicy
+struct variableTable* shellVariables;   // variables set by assignments, export and the environment smallsh started with
+
+/****
+ * Setup the signals for the parent smallsh process
+ * SIGCHLD, SIGINT and SIGTSTP are read from a signalfd by the event loop in events.c instead of being caught.
+ * This function references Exploration: Signal Handling API.
+****/
+void smallsh_signals(){
+  struct sigaction SIGPIPE_action = {0};
+
+  // Ignore SIGPIPE, so a pipeline stage that exits early cannot kill smallsh while it relays data
+  SIGPIPE_action.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &SIGPIPE_action, NULL);
+
+  initEvents();
+}
+
+/*
+// Runs the user's command, first checking if it is a builtin.
+// If a command requests a builtin then it runs the function without forking and running exec().
+// If a command is not a built in, each stage of it is launched in a new process with launchPipeline().
+// Takes a command as input and returns either 0 on success and 1 on failure.
+*/
+int runCommand(struct command* smallsh_command, struct jobTable* jobs){
+    
+    struct builtin* builtin;
+    struct scriptFunction* function;
+    struct command* stage;
+    int numStages = 0;
+    int timed = 0;
+    long long timeStarted = 0;
+    struct rusage timedUsage = {0};
+    struct launchPolicy* policy = NULL;
+    struct variable* savedVariables = NULL;
+    int i;
+
+    // If argc is 0, this is a comment or blank line and the function returns
+    if(smallsh_command->argc == 0){
+        return 0;
+    }
+
+    // NAME=value words before the command name only set the variables for the command
+    for(stage = smallsh_command; stage != NULL; stage = stage->next){
+        stage->assignments = stage->args;
+        stage->args += stage->numAssignments;
+        stage->argc -= stage->numAssignments;
+    }
+
+    // without a command they set shell variables, and the status is that of the last command substitution if any
+    if(smallsh_command->argc == 0 && smallsh_command->next == NULL){
+        for(i = 0; i < smallsh_command->numAssignments; i++){
+            assignVariable(shellVariables, smallsh_command->assignments[i], 0);
+        }
+        if(!smallsh_command->substituted){
+            exitStatus = 0;
+        }
+        return 0;
+    }
+
+    // "time command" runs the command, then prints how long it took and the resources its processes used
+    if(smallsh_command->argc > 1 && strcmp(smallsh_command->args[0], "time") == 0){
+        timed = 1;
+        timeStarted = monotonicNs();
+        smallsh_command->args++;
+        smallsh_command->argc--;
+    }
+
+    // "launch [options] command" runs command with a CPU affinity, scheduling policy or resource limits
+    if(smallsh_command->argc > 0 && strcmp(smallsh_command->args[0], "launch") == 0){
+        policy = launchPrefix(commandArena, smallsh_command);
+        if(policy == NULL){
+            exitStatus = 2;
+            return 1;
+        }
+    }
+
+    for(stage = smallsh_command; stage != NULL; stage = stage->next){
+        if(stage->argc == 0){
+            fprintf(stderr, "smallsh: missing command in pipeline\n");
+            fflush(stderr);
+            exitStatus = 1;
+            return 1;
+        }
+        numStages++;
+    }
+
+    // Check if the command is a builtin function and call the function if it is, otherwise execute as a non-builtin command.
+    // Builtins run inside smallsh, so they cannot be a stage of a pipeline.
+    // A utility builtin such as echo is left to the program of the same name when the command runs in the background.
+    // Functions defined by scripts are looked up first, so they can replace builtins and programs.
+    function = numStages == 1 ? findFunction(scriptFunctions, smallsh_command->args[0]) : NULL;
+    builtin = numStages == 1 && function == NULL ? findBuiltin(smallsh_command->args[0]) : NULL;
+    if(builtin != NULL && (builtin->flags & BUILTIN_UTILITY) && (smallsh_command->background == 1 || policy != NULL)){
+        builtin = NULL;
+    }
+
+    // assignments before a function or builtin are set while it runs, since it runs inside smallsh
+    if((function != NULL || builtin != NULL) && smallsh_command->numAssignments > 0){
+        savedVariables = saveVariables(shellVariables, commandArena, smallsh_command->assignments, smallsh_command->numAssignments);
+    }
+    if(function != NULL){
+        callFunction(function, smallsh_command);
+    } else if(builtin != NULL){
+        runBuiltin(builtin, smallsh_command);
+    } else {
+        int lastStatus = 1 << 8;    // a last stage that could not be started counts as exit status 1
+        int started;
+        int relay = relayPipes && !smallsh_command->background && numStages > 1;
+        pid_t* pids = arenaAlloc(commandArena, numStages * sizeof(pid_t));
+        int* upstream = arenaAlloc(commandArena, numStages * sizeof(int));
+        int* downstream = arenaAlloc(commandArena, numStages * sizeof(int));
+
+        // every stage is launched with the command's policy, and a background job also with the background policy
+        policy = jobPolicy(commandArena, policy, smallsh_command->background);
+        for(stage = smallsh_command; stage != NULL; stage = stage->next){
+            stage->policy = policy;
+            // a stage with assignments gets its own copy of the environment, the others share the exported one
+            if(stage->numAssignments > 0){
+                stage->environment = commandEnvironment(shellVariables, commandArena, stage->assignments, stage->numAssignments);
+            }
+        }
+
+        started = launchPipeline(smallsh_command, pids, relay, upstream, downstream);
+        if(started == 0){
+            // the command could not be started
+            exitStatus = 1;
+            return 1;
+        }
+
+        // If background is false, wait for the pipeline to finish, otherwise continue with it running in background
+        if(smallsh_command->background == 0){
+            if(relay){
+                relayPipeline(upstream, downstream, numStages - 1);
+            }
+            int* statuses = arenaAlloc(commandArena, numStages * sizeof(int));
+            waitPipeline(jobs, pids, numStages, statuses, &timedUsage);
+            if(pids[numStages - 1] != -1){
+                lastStatus = statuses[numStages - 1];
+            }
+            if(WIFSIGNALED(lastStatus) && WTERMSIG(lastStatus) == SIGINT){
+                foregroundInterrupted = 1;
+            }
+            // the status of a pipeline is the status of its last stage
+            if(WIFSIGNALED(lastStatus)){
+                printf("foreground process %d terminated by signal: %d\n", pids[numStages - 1], WTERMSIG(lastStatus));
+            }
+            exitStatus = exitCode(lastStatus); // set the exit status of the last foreground process that terminated
+        } else {
+            // Compact the pids of the stages that started, the first is the process group id of the job
+            int numPids = 0;
+            for(i = 0; i < numStages; i++){
+                if(pids[i] != -1){
+                    pids[numPids] = pids[i];
+                    numPids++;
+                }
+            }
+
+            // Print the pid of the new background process
+            printf("background pid is %d\n", pids[0]);
+            fflush(stdout);
+            
+            exitStatus = 0;
+            lastBackgroundPid = pids[numPids - 1];
+            addJob(jobs, pids, numPids, commandLine(smallsh_command), describePolicy(policy)); // store the new background job so that its status can be tracked
+        }
+    }
+
+    if(savedVariables != NULL){
+        restoreVariables(shellVariables, smallsh_command->assignments, savedVariables, smallsh_command->numAssignments);
+    }
+    if(timed){
+        printTime(monotonicNs() - timeStarted, &timedUsage);
+    }
+    return 0;
+}
+
+/*
+// Run a script file or -c commands in batch mode, then exit with the status of the last command.
+// The whole input is parsed before anything runs. With a cache directory, the parsed form of a script file
+// is loaded from the cache if the file has not changed since it was stored, so the script is not read or parsed again.
+*/
+void runBatch(){
+    int parsed;
+
+    if(scriptCacheDir != NULL && batch->path != NULL){
+        commandScript = loadCachedScript(scriptCacheDir, batch->path, &batch->info);
+    }
+    if(commandScript == NULL){
+        commandScript = initScript();
+        parsed = parseScript(commandScript, 0);
+        if(parsed == 1){
+            smallsh_exit(2);
+        }
+        if(scriptCacheDir != NULL && batch->path != NULL){
+            saveCachedScript(scriptCacheDir, batch->path, &batch->info, commandScript);
+        }
+    }
+    runScript(commandScript);
+    smallsh_exit(exitStatus);
+}
+
+void smallsh(){
+    int loop = 1;
+    int parsed;
+
+    // Loop until exit command is called
+    smallsh_signals();
+    if(batch != NULL){
+        runBatch();
+    }
+
+    // lines are only recorded when they are typed at a terminal, as in sh
+    if(isatty(STDIN_FILENO)){
+        openHistory();
+    }
+    commandScript = initScript();
+    while(loop){
+        // Report background processes that finished and SIGTSTPs that arrived while a command was running
+        handleSignals(0);
+
+        // get and parse input, which may continue on more lines if it starts an if, a loop or a function,
+        // and exit with the status of the last foreground command at the end of input
+        resetScript(commandScript);
+        parsed = parseScript(commandScript, 1);
+        if(parsed == -1){
+            smallsh_exit(exitStatus);
+        }
+        if(parsed == 1){
+            exitStatus = 2;
+            continue;
+        }
+
+        // execute the commands
+        runScript(commandScript);
+
+        // clean up memory used by the line in one step
+        resetArena(commandArena);
+    }
+}
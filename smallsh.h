@@ -0,0 +1,570 @@
+/***************************************
+ * Smallsh: declarations shared by every module
+***************************************/
+#ifndef SMALLSH_H
+#define SMALLSH_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <ctype.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <sched.h>
+
+#define ARENA_BLOCK_SIZE 4096       // size of the first block of an arena, which grows as long lines need it
+#define LAUNCH_SPAWN 0              // launch external commands with posix_spawn()
+#define LAUNCH_FORK 1               // launch external commands with fork() and exec()
+#define HISTOGRAM_BUCKETS 32        // buckets of a stats histogram, each twice as wide as the one before
+#define BUILTIN_UTILITY 1           // builtin that stands in for a program of the same name, which runs instead in the background
+#define BUILTIN_OWN_INPUT 2         // builtin that opens its < file itself instead of reading it from stdin
+#define POLICY_AFFINITY 1           // settings of a launch policy, see struct launchPolicy
+#define POLICY_NICE 2
+#define POLICY_SCHED 4
+#define POLICY_LIMITS 8
+#define POLICY_MAX_LIMITS 16        // most resource limits in a launch policy
+#define VARIABLE_EXPORTED 1         // variable that is passed to the commands smallsh launches
+#define REDIRECT_OPEN 0             // kinds of redirection, see struct redirection
+#define REDIRECT_DUP 1
+#define REDIRECT_CLOSE 2
+#define REDIRECT_STRING 3
+#define NODE_COMMAND 0              // simple command or pipeline, text is its words
+#define NODE_AND 1                  // first && second
+#define NODE_OR 2                   // first || second
+#define NODE_IF 3                   // if first; then second; else third; fi
+#define NODE_WHILE 4                // while first; do second; done
+#define NODE_UNTIL 5                // until first; do second; done
+#define NODE_FOR 6                  // for text in words; do second; done
+#define NODE_GROUP 7                // { first; }
+#define NODE_FUNCTION 8             // text() { first; }
+#define CONTROL_NONE 0              // values of scriptControl
+#define CONTROL_BREAK 1
+#define CONTROL_CONTINUE 2
+#define CONTROL_RETURN 3
+#define CONTROL_INTERRUPT 4         // a command typed at the prompt was killed by SIGINT, stop the rest of the line
+
+extern char **environ;
+
+/*
+// A redirection of a command, compiled by parseInput() from one of:
+//  [n]<file [n]>file [n]>>file     REDIRECT_OPEN, opens text with flags onto fd
+//  [n]<&m [n]>&m                   REDIRECT_DUP, makes fd a copy of source
+//  [n]<&- [n]>&-                   REDIRECT_CLOSE, closes fd
+//  [n]<<<text                      REDIRECT_STRING, fd reads text and a newline
+*/
+struct redirection{
+    int type;
+    int fd;
+    int flags;                  // open() flags of REDIRECT_OPEN
+    int source;                 // fd copied by REDIRECT_DUP, -1 if its word is not an fd
+    char* text;                 // the word after the operator
+};
+
+struct command{
+    char** args;
+    int argc;
+    struct redirection* redirections;   // applied in order, after the pipes of a pipeline are connected
+    int numRedirections;
+    int background;
+    struct launchPolicy* policy;    // CPU affinity, scheduling and resource limits to launch the stage with, NULL for none
+    char** assignments;         // NAME=value words before the command name, which parseInput() leaves at the start of args
+    int numAssignments;
+    char** environment;         // environment to launch the stage with, NULL for the exported variables
+    int substituted;            // 1 if a command substitution ran while the line was parsed
+    struct command* next;       // next stage of a pipeline, NULL for the last stage
+};
+
+/*
+// A resource limit of a launch policy
+*/
+struct policyLimit{
+    int resource;               // such as RLIMIT_NOFILE
+    struct rlimit limit;
+};
+
+/*
+// How to launch the processes of a command, applied in the child before exec().
+// Only the settings whose POLICY_ flag is in set are applied.
+*/
+struct launchPolicy{
+    int set;
+    cpu_set_t cpus;             // CPUs the processes may run on
+    int nice;
+    int schedPolicy;            // such as SCHED_BATCH
+    int schedPriority;          // static priority for SCHED_FIFO and SCHED_RR
+    int numLimits;
+    struct policyLimit limits[POLICY_MAX_LIMITS];
+};
+
+/*
+// A block of memory owned by an arena
+*/
+struct arenaBlock{
+    struct arenaBlock* next;
+    size_t size;
+    size_t used;
+    _Alignas(max_align_t) char data[];  // starts aligned for any type, as malloc() returns the block
+};
+
+/*
+// Bump allocator for everything that lives only as long as one command line.
+// Allocations are never freed individually, the whole arena is reset in one step before the next line.
+*/
+struct arena{
+    struct arenaBlock* head;    // block that allocations are currently taken from
+};
+
+/*
+// A position in an arena, see arenaMark()
+*/
+struct arenaMark{
+    struct arenaBlock* block;
+    size_t used;
+};
+
+/*
+// A script or -c command that smallsh reads lines from in batch mode.
+// The lines are split in place, so data must be writable. A script file is mapped privately, so writes never reach the file.
+*/
+struct batchInput{
+    char* data;
+    size_t len;
+    size_t pos;                 // start of the next line
+    int mapped;                 // 1 if data was mapped with mmap(), 0 if it was allocated
+    char* lastLine;             // copy of a last line that does not end with '\n'
+    char* path;                 // path of a script file, NULL for -c
+    struct stat info;           // status of the script file when it was opened
+};
+
+/*
+// A background job, which is a single command or a pipeline running in its own process group.
+// A slot with a pid of 0 is free and is linked into the table's free list.
+*/
+struct job{
+    pid_t pid;                  // process group id, which is the pid of the first process
+    pid_t lastPid;              // pid of the last process, its status is the status of the job
+    int remaining;              // number of processes that have not been reaped yet
+    int status;                 // wait status of the last process once it has been reaped
+    char* commandLine;
+    char* policy;               // description of the launch policy of the job, NULL if it has none
+    int nextFree;
+};
+
+/*
+// Entry of a pid map. A value of -1 marks an empty bucket.
+*/
+struct pidEntry{
+    pid_t pid;
+    int value;
+};
+
+/*
+// Open addressing hash table (linear probing) from a pid to a non-negative integer, such as a slot in another table
+*/
+struct pidMap{
+    struct pidEntry* entries;
+    int count;
+    int capacity;               // always a power of two
+};
+
+/*
+// A command name and the absolute path it was resolved to through PATH.
+// An entry with a NULL name is empty.
+*/
+struct pathEntry{
+    char* name;
+    char* path;
+    int hits;                   // number of times the entry was used
+};
+
+/*
+// Cache of command paths, an open addressing hash table (linear probing) keyed by command name.
+// It is only valid for the value of PATH it was filled with and is cleared when PATH changes.
+*/
+struct pathCache{
+    struct pathEntry* entries;
+    int count;
+    int capacity;               // always a power of two
+    char* pathVar;              // copy of PATH when the cache was filled
+};
+
+/*
+// A shell variable, stored as the "NAME=value" string that the environment of commands points to.
+// An entry with a NULL text is empty.
+*/
+struct variable{
+    char* text;
+    size_t nameLen;
+    int flags;                  // VARIABLE_EXPORTED
+    int envIndex;               // position of text in the environment array, -1 if it is not in it
+};
+
+/*
+// Shell variables, an open addressing hash table (linear probing) keyed by name, with the environment
+// array of the exported variables that commands are launched with.
+*/
+struct variableTable{
+    struct variable* entries;
+    int count;
+    int capacity;               // always a power of two
+    char** environment;         // "NAME=value" of every exported variable, ending with NULL
+    int environmentCount;
+    int environmentCapacity;
+    int environmentStale;       // 1 if an exported variable changed since environment was built
+};
+
+/*
+// The entries of a directory, as the records getdents64() returned them, see glob.c
+*/
+struct globDir{
+    char* path;                 // NULL for an empty slot of the cache
+    char* entries;
+    size_t len;
+};
+
+/*
+// Directory listings read while expanding the patterns of one line, an open addressing hash table keyed by path
+*/
+struct globCache{
+    struct arena* arena;
+    struct globDir* dirs;
+    int count;
+    int capacity;               // always a power of two
+};
+
+/*
+// Resource usage of every process run for one command name
+*/
+struct commandStats{
+    char* name;
+    long runs;
+    long long spawnNs;          // total time spent starting processes
+    long long wallNs;           // total time from start to exit
+    long long userUs;
+    long long sysUs;
+    long maxRssKb;              // largest max RSS of any run
+    long voluntarySwitches;
+    long involuntarySwitches;
+    long spawnHistogram[HISTOGRAM_BUCKETS];
+    long runtimeHistogram[HISTOGRAM_BUCKETS];
+};
+
+/*
+// A process that has been started but not reaped yet
+*/
+struct runningProcess{
+    int command;                // index of the command's stats, -1 if they were reset
+    long long started;
+    long long spawnNs;
+    int nextFree;
+};
+
+/*
+// Stats for every command name, kept in an array and found through an open addressing index of names.
+// Running processes are kept in slots found by pid so their stats can be completed when they are reaped.
+*/
+struct statsTable{
+    struct commandStats* commands;
+    int numCommands;
+    int commandCapacity;
+    int* nameIndex;             // index into commands for each bucket, -1 for an empty bucket
+    int indexCapacity;          // always a power of two
+    struct runningProcess* running;
+    int runningUsed;
+    int runningCapacity;
+    int freeRunning;            // first free slot of running, -1 if there is none
+    struct pidMap* pids;        // maps the pid of each running process to its slot
+    FILE* log;                  // JSON lines log of every process, NULL if there is none
+};
+
+/*
+// Table of background jobs.
+// Job number n is stored in slots[n - 1], so lookup by job number is an array index.
+// Free slots are kept on a list and reused before the table grows, so job numbers stay small.
+*/
+struct jobTable{
+    struct job* slots;
+    int capacity;
+    int used;                   // number of slots that have ever been handed out
+    int count;                  // number of live jobs
+    int freeHead;               // first free slot below used, -1 if there is none
+    struct pidMap* pids;        // maps the pid of every process of every job to the job's slot
+};
+
+/*
+// A node of a parsed script. Nodes refer to other nodes by their index in the script and to text by its offset
+// in the script's strings, -1 if there is none, so a script can be stored in a file and used where it is mapped.
+// The nodes of a list are linked through next.
+*/
+struct scriptNode{
+    int type;                   // one of the NODE_ constants
+    int text;
+    int words;
+    int first;
+    int second;
+    int third;
+    int next;
+};
+
+/*
+// A parsed script or command line
+*/
+struct script{
+    struct scriptNode* nodes;
+    int numNodes;
+    int nodeCapacity;
+    char* strings;              // '\0' terminated texts of the nodes
+    size_t stringsLen;
+    size_t stringsCapacity;
+    int root;                   // first node of the top level list, -1 if it is empty
+    int references;             // the script is freed when this drops to 0
+    void* mapping;              // cache file the nodes and strings are in, NULL if they were allocated
+    size_t mappingLen;
+};
+
+/*
+// A function defined by a script. An entry with a NULL name is empty.
+*/
+struct scriptFunction{
+    char* name;
+    struct script* body;        // copy of the function's body
+};
+
+/*
+// Open addressing hash table (linear probing) of the functions that have been defined, keyed by name
+*/
+struct functionTable{
+    struct scriptFunction* entries;
+    int count;
+    int capacity;               // always a power of 2
+};
+
+/*
+// A command that runs inside smallsh, found by its exact name
+*/
+struct builtin{
+    char* name;
+    void (*run)(struct command* smallsh_command);
+    int flags;                  // BUILTIN_UTILITY and BUILTIN_OWN_INPUT
+};
+
+// shell.c
+extern struct batchInput* batch;        // input for batch mode, NULL when reading commands from stdin
+extern struct arena* commandArena;      // memory for the command line currently being parsed and run
+extern struct pathCache* commandPaths;  // absolute paths of the commands that have been run
+extern struct statsTable* commandStats;
+extern struct jobTable* backgroundJobs; // table of background processes that have not been reaped yet
+extern int runBackground;               // If runBackground is set to 1, background processes can be run. If 0, they are restricted to foreground.
+extern int exitStatus;                  // exit code of the last foreground command, 128 + signal number if it was killed by a signal
+extern pid_t lastBackgroundPid;         // pid of the last background process, expanded by $!
+extern int launchMode;                  // backend used to start external commands, selected at startup
+extern int relayPipes;                  // If relayPipes is set to 1, smallsh moves the data between foreground pipeline stages with splice()
+extern struct functionTable* scriptFunctions;   // functions defined by scripts and at the prompt
+extern struct script* commandScript;    // the script being run, or the parsed form of the last line read at the prompt
+extern int scriptControl;               // pending break, continue or return, one of the CONTROL_ constants
+extern int foregroundInterrupted;       // set when a foreground command is killed by SIGINT or smallsh reads a SIGINT while waiting for it
+extern char** positionalArgs;           // $0, $1, ... terminated by NULL
+extern int positionalCount;             // number of positional parameters after $0, expanded by $#
+extern char* scriptCacheDir;            // directory that parsed scripts are cached in, NULL if caching is off
+extern struct launchPolicy backgroundPolicy;    // policy that background jobs are launched with, set by bgpolicy
+extern struct variableTable* shellVariables;    // variables set by assignments, export and the environment smallsh started with
+
+// arena.c
+struct arena* initArena();
+void* arenaAlloc(struct arena* arena, size_t size);
+void* arenaGrow(struct arena* arena, void* ptr, size_t oldSize, size_t newSize);
+struct arenaMark arenaMark(struct arena* arena);
+void arenaRelease(struct arena* arena, struct arenaMark mark);
+void resetArena(struct arena* arena);
+void freeArena(struct arena* arena);
+
+// parse.c
+struct command* initCommand(struct arena* arena, int maxArgs);
+char* wordEnd(char* text);
+struct command* parseInput(struct arena* arena, char* input);
+
+// pidmap.c
+struct pidMap* initPidMap();
+void freePidMap(struct pidMap* map);
+void pidMapInsert(struct pidMap* map, pid_t pid, int value);
+int pidMapFind(struct pidMap* map, pid_t pid);
+int pidMapGet(struct pidMap* map, pid_t pid);
+void pidMapRemoveBucket(struct pidMap* map, int bucket);
+int pidMapRemove(struct pidMap* map, pid_t pid);
+
+// jobs.c
+struct jobTable* initJobTable();
+void freeJobTable(struct jobTable* table);
+int addJob(struct jobTable* table, pid_t* pids, int numPids, char* commandLine, char* policy);
+int findJobByPid(struct jobTable* table, pid_t pid);
+int findJobByNumber(struct jobTable* table, int jobNumber);
+void removeJob(struct jobTable* table, int slot);
+int reportJob(struct jobTable* table, pid_t childPid, int childStatus);
+int reapJobs(struct jobTable* table);
+void waitPipeline(struct jobTable* table, pid_t* pids, int numPids, int* statuses, struct rusage* total);
+int waitJob(struct jobTable* table, int slot);
+char* commandLine(struct command* smallsh_command);
+int exitCode(int childStatus);
+
+// pathcache.c
+unsigned int hashString(const char* text);
+struct pathCache* initPathCache();
+void clearPathCache(struct pathCache* cache);
+void freePathCache(struct pathCache* cache);
+char* searchPath(const char* name, const char* pathVar);
+char* lookupCommand(struct pathCache* cache, char* name);
+void forgetCommand(struct pathCache* cache, char* name);
+
+// stats.c
+long long monotonicNs();
+struct statsTable* initStats(char* logPath);
+void resetStats(struct statsTable* stats);
+void freeStats(struct statsTable* stats);
+void statsLaunched(struct statsTable* stats, pid_t pid, char* name, long long started, long long spawnNs);
+void statsReaped(struct statsTable* stats, pid_t pid, int childStatus, struct rusage* usage);
+void printStats(struct statsTable* stats);
+void addUsage(struct rusage* total, struct rusage* usage);
+void printTime(long long wallNs, struct rusage* usage);
+
+// input.c
+struct batchInput* openScript(char* path);
+struct batchInput* openCommandString(char* commands);
+void closeBatchInput(struct batchInput* input);
+char* getBatchLine(struct batchInput* input);
+char* getInput(char* prompt);
+int readInputChar();
+
+// builtins.c
+void smallsh_exit(int status);
+void smallsh_cd(struct command* smallsh_command);
+void smallsh_status(struct command* smallsh_command);
+int parseJobSpec(struct jobTable* table, char* spec);
+void smallsh_jobs(struct command* smallsh_command);
+void smallsh_wait(struct command* smallsh_command);
+void smallsh_kill(struct command* smallsh_command);
+void smallsh_hash(struct command* smallsh_command);
+void smallsh_stats(struct command* smallsh_command);
+struct builtin* findBuiltin(char* name);
+void runBuiltin(struct builtin* builtin, struct command* smallsh_command);
+
+// utilities.c
+void smallsh_echo(struct command* smallsh_command);
+void smallsh_printf(struct command* smallsh_command);
+void smallsh_test(struct command* smallsh_command);
+void smallsh_pwd(struct command* smallsh_command);
+void smallsh_true(struct command* smallsh_command);
+void smallsh_false(struct command* smallsh_command);
+void smallsh_read(struct command* smallsh_command);
+
+// script.c
+struct script* initScript();
+void resetScript(struct script* script);
+void releaseScript(struct script* script);
+int parseScript(struct script* script, int oneLine);
+struct functionTable* initFunctionTable();
+void freeFunctionTable(struct functionTable* table);
+struct scriptFunction* findFunction(struct functionTable* table, char* name);
+void defineFunction(struct functionTable* table, char* name, struct script* from, int body);
+void callFunction(struct scriptFunction* function, struct command* smallsh_command);
+void runList(struct script* script, int node);
+void runScript(struct script* script);
+void smallsh_break(struct command* smallsh_command);
+void smallsh_continue(struct command* smallsh_command);
+void smallsh_return(struct command* smallsh_command);
+
+// subst.c
+char* commandOutput(struct arena* arena, char* commands, size_t len, size_t* outputLen);
+
+// scriptcache.c
+struct script* loadCachedScript(char* dir, char* path, struct stat* info);
+void saveCachedScript(char* dir, char* path, struct stat* info, struct script* script);
+
+// parallel.c
+void smallsh_parallel(struct command* smallsh_command);
+
+// events.c
+void initEvents();
+int signalEvents();
+void toggleForegroundOnly();
+int handleSignals(int atPrompt);
+void waitForChild();
+void waitForInput(char* prompt);
+
+// redirect.c
+int nullDevice();
+int redirectsFd(struct command* smallsh_command, int fd);
+char* inputFile(struct command* smallsh_command);
+int applyRedirections(struct command* smallsh_command);
+int spawnRedirections(struct command* smallsh_command, posix_spawn_file_actions_t* actions, int* openFds);
+int redirectShell(struct command* smallsh_command, int ownInput, int** saved);
+void restoreShell(struct command* smallsh_command, int* saved);
+
+// vars.c
+size_t variableNameLen(const char* text);
+struct variableTable* initVariables(char** environment);
+void freeVariables(struct variableTable* table);
+char* getVariable(struct variableTable* table, const char* name);
+void setVariable(struct variableTable* table, const char* name, const char* value, int flags);
+int assignVariable(struct variableTable* table, const char* assignment, int flags);
+void unsetVariable(struct variableTable* table, const char* name);
+char** exportedEnvironment(struct variableTable* table);
+char** commandEnvironment(struct variableTable* table, struct arena* arena, char** assignments, int count);
+struct variable* saveVariables(struct variableTable* table, struct arena* arena, char** assignments, int count);
+void restoreVariables(struct variableTable* table, char** assignments, struct variable* saved, int count);
+void smallsh_export(struct command* smallsh_command);
+void smallsh_unset(struct command* smallsh_command);
+
+// history.c
+void openHistory();
+void closeHistory();
+void addHistory(char* line);
+char* expandHistory(char* line);
+void smallsh_history(struct command* smallsh_command);
+
+// glob.c
+struct globCache* initGlobCache(struct arena* arena);
+int expandGlob(struct globCache* cache, char* pattern, char*** matches);
+
+// policy.c
+int parsePolicyOptions(struct launchPolicy* policy, char** args);
+struct launchPolicy* launchPrefix(struct arena* arena, struct command* smallsh_command);
+struct launchPolicy* jobPolicy(struct arena* arena, struct launchPolicy* policy, int background);
+int applyPolicy(struct launchPolicy* policy);
+char* describePolicy(struct launchPolicy* policy);
+void smallsh_bgpolicy(struct command* smallsh_command);
+
+// serve.c
+int serve(char* path, int limit);
+int connectServer(char* path);
+int runRequest(int fd, char* commands, size_t len);
+int runClient(char* path, struct batchInput* input);
+
+// launch.c
+void foreground_SIGINT(int num);
+pid_t forkCommand(struct command* smallsh_command, char* path, int inFd, int outFd, pid_t pgid);
+pid_t spawnCommand(struct command* smallsh_command, char* path, int inFd, int outFd, pid_t pgid);
+pid_t launchCommand(struct command* smallsh_command, int inFd, int outFd, pid_t pgid);
+int launchPipeline(struct command* pipeline, pid_t* pids, int relay, int* upstream, int* downstream);
+void relayPipeline(int* upstream, int* downstream, int links);
+
+// shell.c
+void smallsh_signals();
+void runBatch();
+int runCommand(struct command* smallsh_command, struct jobTable* jobs);
+void smallsh();
+
+#endif
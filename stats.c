@@ -0,0 +1,327 @@
+/***************************************
+ * Smallsh: per-command resource accounting
+***************************************/
+#include "smallsh.h"
+
+/*
+// Current time of the monotonic clock in nanoseconds
+*/
+long long monotonicNs(){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+// Allocate memory and initialize an empty stats table.
+// If logPath is not NULL, the metrics of every process are appended to it as JSON lines.
+// Returns NULL and prints an error if the log cannot be opened.
+*/
+struct statsTable* initStats(char* logPath){
+    int i;
+    struct statsTable* stats = calloc(1, sizeof(struct statsTable));
+
+    if(logPath != NULL){
+        int fd = open(logPath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0640);
+        if(fd == -1){
+            perror(logPath);
+            free(stats);
+            return NULL;
+        }
+        stats->log = fdopen(fd, "a");
+    }
+
+    stats->commandCapacity = 16;
+    stats->commands = calloc(stats->commandCapacity, sizeof(struct commandStats));
+    stats->indexCapacity = 32;
+    stats->nameIndex = malloc(stats->indexCapacity * sizeof(int));
+    for(i = 0; i < stats->indexCapacity; i++){
+        stats->nameIndex[i] = -1;
+    }
+
+    stats->runningCapacity = 16;
+    stats->running = malloc(stats->runningCapacity * sizeof(struct runningProcess));
+    stats->freeRunning = -1;
+    stats->pids = initPidMap();
+    return stats;
+}
+
+/*
+// Forget the stats of every command. Processes that are still running are kept.
+*/
+void resetStats(struct statsTable* stats){
+    int i;
+
+    for(i = 0; i < stats->numCommands; i++){
+        free(stats->commands[i].name);
+    }
+    memset(stats->commands, 0, stats->commandCapacity * sizeof(struct commandStats));
+    stats->numCommands = 0;
+    for(i = 0; i < stats->indexCapacity; i++){
+        stats->nameIndex[i] = -1;
+    }
+    // running processes refer to commands by index, they are no longer counted
+    for(i = 0; i < stats->runningUsed; i++){
+        stats->running[i].command = -1;
+    }
+}
+
+/*
+// Free all memory associated with a stats table and close its log
+*/
+void freeStats(struct statsTable* stats){
+    int i;
+
+    if(stats != NULL){
+        for(i = 0; i < stats->numCommands; i++){
+            free(stats->commands[i].name);
+        }
+        if(stats->log != NULL){
+            fclose(stats->log);
+        }
+        free(stats->commands);
+        free(stats->nameIndex);
+        free(stats->running);
+        freePidMap(stats->pids);
+        free(stats);
+    }
+}
+
+/*
+// Find the stats of a command by name, adding an entry if it is new. Returns the entry's index.
+*/
+static int findCommandStats(struct statsTable* stats, char* name){
+    int i;
+    int bucket;
+
+    bucket = hashString(name) & (stats->indexCapacity - 1);
+    while(stats->nameIndex[bucket] != -1){
+        if(strcmp(stats->commands[stats->nameIndex[bucket]].name, name) == 0){
+            return stats->nameIndex[bucket];
+        }
+        bucket = (bucket + 1) & (stats->indexCapacity - 1);
+    }
+
+    if(stats->numCommands == stats->commandCapacity){
+        stats->commandCapacity *= 2;
+        stats->commands = realloc(stats->commands, stats->commandCapacity * sizeof(struct commandStats));
+        memset(stats->commands + stats->numCommands, 0, (stats->commandCapacity - stats->numCommands) * sizeof(struct commandStats));
+    }
+    stats->commands[stats->numCommands].name = strdup(name);
+    stats->nameIndex[bucket] = stats->numCommands;
+    stats->numCommands++;
+
+    // keep the index at most half full
+    if(stats->numCommands * 2 > stats->indexCapacity){
+        stats->indexCapacity *= 2;
+        stats->nameIndex = realloc(stats->nameIndex, stats->indexCapacity * sizeof(int));
+        for(i = 0; i < stats->indexCapacity; i++){
+            stats->nameIndex[i] = -1;
+        }
+        for(i = 0; i < stats->numCommands; i++){
+            bucket = hashString(stats->commands[i].name) & (stats->indexCapacity - 1);
+            while(stats->nameIndex[bucket] != -1){
+                bucket = (bucket + 1) & (stats->indexCapacity - 1);
+            }
+            stats->nameIndex[bucket] = i;
+        }
+    }
+    return stats->numCommands - 1;
+}
+
+/*
+// Histogram bucket of a duration: bucket 0 counts durations under 1us, bucket i counts durations of [2^(i-1), 2^i) us.
+*/
+static int histogramBucket(long long ns){
+    long long us = ns / 1000;
+    int bucket = 0;
+
+    while(us > 0 && bucket < HISTOGRAM_BUCKETS - 1){
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+// Record that a process was started.
+// started is when the launch began and spawnNs is how long it took until the process was running.
+*/
+void statsLaunched(struct statsTable* stats, pid_t pid, char* name, long long started, long long spawnNs){
+    int slot;
+    struct commandStats* command;
+
+    if(stats == NULL){
+        return;
+    }
+
+    if(stats->freeRunning != -1){
+        slot = stats->freeRunning;
+        stats->freeRunning = stats->running[slot].nextFree;
+    } else {
+        if(stats->runningUsed == stats->runningCapacity){
+            stats->runningCapacity *= 2;
+            stats->running = realloc(stats->running, stats->runningCapacity * sizeof(struct runningProcess));
+        }
+        slot = stats->runningUsed;
+        stats->runningUsed++;
+    }
+
+    stats->running[slot].command = findCommandStats(stats, name);
+    stats->running[slot].started = started;
+    stats->running[slot].spawnNs = spawnNs;
+    pidMapInsert(stats->pids, pid, slot);
+
+    command = &stats->commands[stats->running[slot].command];
+    command->spawnNs += spawnNs;
+    command->spawnHistogram[histogramBucket(spawnNs)]++;
+}
+
+/*
+// Write a string to the log as a JSON string
+*/
+static void logString(FILE* log, char* text){
+    fputc('"', log);
+    for(; *text != '\0'; text++){
+        if(*text == '"' || *text == '\\'){
+            fprintf(log, "\\%c", *text);
+        } else if((unsigned char)*text < 0x20){
+            fprintf(log, "\\u%04x", (unsigned char)*text);
+        } else {
+            fputc(*text, log);
+        }
+    }
+    fputc('"', log);
+}
+
+/*
+// Record that a process was reaped, with the status and resource usage returned by wait4().
+// Processes that were not started through statsLaunched() are ignored.
+*/
+void statsReaped(struct statsTable* stats, pid_t pid, int childStatus, struct rusage* usage){
+    int slot;
+    long long wallNs;
+    long long userUs = (long long)usage->ru_utime.tv_sec * 1000000 + usage->ru_utime.tv_usec;
+    long long sysUs = (long long)usage->ru_stime.tv_sec * 1000000 + usage->ru_stime.tv_usec;
+    struct runningProcess* process;
+    struct commandStats* command;
+
+    if(stats == NULL || (slot = pidMapRemove(stats->pids, pid)) == -1){
+        return;
+    }
+    process = &stats->running[slot];
+    wallNs = monotonicNs() - process->started;
+
+    if(process->command != -1){
+        command = &stats->commands[process->command];
+        command->runs++;
+        command->wallNs += wallNs;
+        command->userUs += userUs;
+        command->sysUs += sysUs;
+        if(usage->ru_maxrss > command->maxRssKb){
+            command->maxRssKb = usage->ru_maxrss;
+        }
+        command->voluntarySwitches += usage->ru_nvcsw;
+        command->involuntarySwitches += usage->ru_nivcsw;
+        command->runtimeHistogram[histogramBucket(wallNs)]++;
+
+        if(stats->log != NULL){
+            fprintf(stats->log, "{\"pid\":%d,\"command\":", pid);
+            logString(stats->log, command->name);
+            fprintf(stats->log, ",\"exit\":%d,\"spawn_us\":%lld,\"wall_us\":%lld,\"user_us\":%lld,\"sys_us\":%lld,\"maxrss_kb\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld}\n",
+                    exitCode(childStatus), process->spawnNs / 1000, wallNs / 1000, userUs, sysUs,
+                    usage->ru_maxrss, usage->ru_nvcsw, usage->ru_nivcsw);
+            fflush(stats->log);
+        }
+    }
+
+    process->nextFree = stats->freeRunning;
+    stats->freeRunning = slot;
+}
+
+/*
+// Format a duration in nanoseconds with a unit that keeps it short
+*/
+static char* formatDuration(char* buffer, size_t size, long long ns){
+    if(ns < 1000000){
+        snprintf(buffer, size, "%lldus", ns / 1000);
+    } else if(ns < 1000000000){
+        snprintf(buffer, size, "%.1fms", ns / 1e6);
+    } else {
+        snprintf(buffer, size, "%.2fs", ns / 1e9);
+    }
+    return buffer;
+}
+
+/*
+// Print the non-empty buckets of a histogram on one line
+*/
+static void printHistogram(char* label, long* histogram){
+    int i;
+    char low[32];
+    char high[32];
+
+    printf("  %-8s", label);
+    for(i = 0; i < HISTOGRAM_BUCKETS; i++){
+        if(histogram[i] > 0){
+            formatDuration(low, sizeof(low), i == 0 ? 0 : (1LL << (i - 1)) * 1000);
+            formatDuration(high, sizeof(high), (1LL << i) * 1000);
+            printf(" [%s,%s):%ld", low, high, histogram[i]);
+        }
+    }
+    printf("\n");
+}
+
+/*
+// Print the stats of every command that has been run, with histograms of spawn latency and runtime
+*/
+void printStats(struct statsTable* stats){
+    int i;
+    char spawn[32];
+    char wall[32];
+    struct commandStats* command;
+
+    for(i = 0; i < stats->numCommands; i++){
+        command = &stats->commands[i];
+        if(command->runs == 0){
+            continue;
+        }
+        printf("%s: %ld runs, spawn avg %s, runtime avg %s, user %.3fs, sys %.3fs, max rss %ldKB, context switches %ld/%ld\n",
+               command->name, command->runs,
+               formatDuration(spawn, sizeof(spawn), command->spawnNs / command->runs),
+               formatDuration(wall, sizeof(wall), command->wallNs / command->runs),
+               command->userUs / 1e6, command->sysUs / 1e6, command->maxRssKb,
+               command->voluntarySwitches, command->involuntarySwitches);
+        printHistogram("spawn", command->spawnHistogram);
+        printHistogram("runtime", command->runtimeHistogram);
+    }
+    fflush(stdout);
+}
+
+/*
+// Add the resource usage of a process to a total for the time builtin
+*/
+void addUsage(struct rusage* total, struct rusage* usage){
+    total->ru_utime.tv_sec += usage->ru_utime.tv_sec;
+    total->ru_utime.tv_usec += usage->ru_utime.tv_usec;
+    total->ru_stime.tv_sec += usage->ru_stime.tv_sec;
+    total->ru_stime.tv_usec += usage->ru_stime.tv_usec;
+    if(usage->ru_maxrss > total->ru_maxrss){
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+}
+
+/*
+// Print the report of the time builtin to stderr
+*/
+void printTime(long long wallNs, struct rusage* usage){
+    fprintf(stderr, "real %.3fs user %.3fs sys %.3fs max rss %ldKB context switches %ld/%ld\n",
+            wallNs / 1e9,
+            usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6,
+            usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6,
+            usage->ru_maxrss, usage->ru_nvcsw, usage->ru_nivcsw);
+    fflush(stderr);
+}
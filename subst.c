@@ -0,0 +1,160 @@
+/***************************************
+ * Smallsh: command substitution
+***************************************/
+#include "smallsh.h"
+
+#define CAPTURE_SIZE 4096           // first size of the buffer that a substitution's output is read into
+
+/*
+// Return the builtin that commands consist of if it can run inside smallsh: a utility builtin such as echo or printf,
+// with no other command, redirection or background '&' on the line, and no function of the same name.
+// Returns NULL if the commands have to run in a separate process.
+*/
+static struct builtin* inProcessBuiltin(char* commands){
+    struct builtin* builtin;
+    char* name = commands + strspn(commands, " \t");
+    size_t nameLen = strcspn(name, " \t");
+    char saved;
+
+    if(strpbrk(commands, ";|&<>\n") != NULL || strcspn(name, " \t'\"\\$`") < nameLen){
+        return NULL;
+    }
+    saved = name[nameLen];
+    name[nameLen] = '\0';
+    builtin = findBuiltin(name);
+    if(builtin != NULL && (!(builtin->flags & BUILTIN_UTILITY) || findFunction(scriptFunctions, name) != NULL)){
+        builtin = NULL;
+    }
+    name[nameLen] = saved;
+    return builtin;
+}
+
+/*
+// Run a utility builtin with stdout captured in memory instead of going through a pipe.
+// Returns the output allocated from arena and sets *outputLen to its length.
+*/
+static char* captureBuiltin(struct arena* arena, struct builtin* builtin, char* commands, size_t* outputLen){
+    struct command* smallsh_command = parseInput(arena, commands);
+    FILE* savedStdout = stdout;
+    char* captured = NULL;
+    size_t capturedLen = 0;
+    char* output;
+
+    // arguments are expanded first, so nested substitutions still write to the real stdout
+    fflush(stdout);
+    stdout = open_memstream(&captured, &capturedLen);
+    if(stdout == NULL){
+        stdout = savedStdout;
+        captured = NULL;
+        capturedLen = 0;
+    } else {
+        if(smallsh_command->argc > 0){
+            runBuiltin(builtin, smallsh_command);
+        }
+        fclose(stdout);
+        stdout = savedStdout;
+    }
+
+    output = arenaAlloc(arena, capturedLen + 1);
+    if(capturedLen > 0){
+        memcpy(output, captured, capturedLen);
+    }
+    free(captured);
+    *outputLen = capturedLen;
+    return output;
+}
+
+/*
+// Run commands in a copy of smallsh and read its stdout from a pipe.
+// The output is read with large reads straight into a buffer in the arena that doubles as it fills.
+// Returns the output and sets *outputLen to its length.
+*/
+static char* captureChild(struct arena* arena, char* commands, size_t* outputLen){
+    size_t capacity = CAPTURE_SIZE;
+    size_t len = 0;
+    char* output = arenaAlloc(arena, capacity);
+    ssize_t numRead;
+    int fds[2];
+    int childStatus;
+    pid_t childPid;
+
+    if(pipe2(fds, O_CLOEXEC) == -1){
+        perror("pipe2()");
+        exitStatus = 1;
+        *outputLen = 0;
+        return output;
+    }
+    // flush every stream, so the child does not write out what smallsh has buffered again
+    fflush(NULL);
+    childPid = fork();
+    if(childPid == -1){
+        perror("fork()");
+        close(fds[0]);
+        close(fds[1]);
+        exitStatus = 1;
+        *outputLen = 0;
+        return output;
+    }
+    if(childPid == 0){
+        // the child runs the commands as a batch script and exits with their status
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        closeBatchInput(batch);
+        batch = openCommandString(commands);
+        commandScript = NULL;
+        scriptControl = CONTROL_NONE;
+        runBatch();
+    }
+    close(fds[1]);
+
+    while(1){
+        if(capacity - len < CAPTURE_SIZE){
+            output = arenaGrow(arena, output, capacity, capacity * 2);
+            capacity *= 2;
+        }
+        numRead = read(fds[0], output + len, capacity - len - 1);
+        if(numRead == -1 && errno == EINTR){
+            continue;
+        }
+        if(numRead <= 0){
+            break;
+        }
+        len += numRead;
+    }
+    close(fds[0]);
+
+    while(waitpid(childPid, &childStatus, 0) == -1 && errno == EINTR);
+    exitStatus = exitCode(childStatus);
+    *outputLen = len;
+    return output;
+}
+
+/*
+// Run the commands of a $(...) or `...` substitution and return what they write to stdout, with the newlines at
+// its end removed and terminated with '\0'. *outputLen is set to its length. The output is allocated from arena
+// and is writable, so it can be split into words in place. Sets exitStatus to the status of the commands.
+// A utility builtin runs inside smallsh with its output captured in memory, anything else runs in a forked copy
+// of smallsh like a -c script, so cd, variables and functions in the substitution do not affect smallsh.
+// commands is the len characters of the substitution's text and does not have to be terminated.
+*/
+char* commandOutput(struct arena* arena, char* commands, size_t len, size_t* outputLen){
+    char* text = arenaAlloc(arena, len + 1);
+    struct builtin* builtin;
+    char* output;
+
+    memcpy(text, commands, len);
+    text[len] = '\0';
+    builtin = inProcessBuiltin(text);
+    if(builtin != NULL){
+        output = captureBuiltin(arena, builtin, text, outputLen);
+    } else {
+        output = captureChild(arena, text, outputLen);
+    }
+
+    while(*outputLen > 0 && output[*outputLen - 1] == '\n'){
+        (*outputLen)--;
+    }
+    output[*outputLen] = '\0';
+    return output;
+}
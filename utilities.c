@@ -0,0 +1,481 @@
+/***************************************
+ * Smallsh: utility builtins
+ * echo, printf, test, pwd, true, false and read run inside smallsh instead of in a new process
+***************************************/
+#include "smallsh.h"
+
+/*
+// Print the arguments separated by spaces and followed by a newline.
+// With -n as the first argument the newline is left out.
+*/
+void smallsh_echo(struct command* smallsh_command){
+    char** args = smallsh_command->args + 1;
+    int newline = 1;
+
+    if(args[0] != NULL && strcmp(args[0], "-n") == 0){
+        newline = 0;
+        args++;
+    }
+    for(; args[0] != NULL; args++){
+        fputs(args[0], stdout);
+        if(args[1] != NULL){
+            putchar(' ');
+        }
+    }
+    if(newline){
+        putchar('\n');
+    }
+    fflush(stdout);
+    exitStatus = 0;
+}
+
+/*
+// Print the backslash escape that starts after the backslash at str.
+// Returns a pointer to the character after the escape, or NULL for \c, which ends the output.
+*/
+static char* printEscape(char* str, int octalZero){
+    int value = 0;
+    int digits = 0;
+
+    switch(*str){
+        case 'a': putchar('\a'); return str + 1;
+        case 'b': putchar('\b'); return str + 1;
+        case 'c': return NULL;
+        case 'f': putchar('\f'); return str + 1;
+        case 'n': putchar('\n'); return str + 1;
+        case 'r': putchar('\r'); return str + 1;
+        case 't': putchar('\t'); return str + 1;
+        case 'v': putchar('\v'); return str + 1;
+        case '\\': putchar('\\'); return str + 1;
+        case '\0': putchar('\\'); return str;
+    }
+
+    // \NNN in a format, \0NNN in a %b argument
+    if(octalZero && *str == '0'){
+        str++;
+    }
+    while(digits < 3 && *str >= '0' && *str <= '7'){
+        value = value * 8 + (*str - '0');
+        str++;
+        digits++;
+    }
+    if(digits == 0){
+        putchar('\\');
+        putchar(*str);
+        return str + 1;
+    }
+    putchar(value);
+    return str;
+}
+
+/*
+// Print one conversion of printf. spec is the conversion with its flags, width and precision, such as "%-8s".
+// Returns 1 if arg is not a valid number for a numeric conversion.
+*/
+static int printConversion(char* spec, size_t specLen, char conversion, char* arg){
+    char format[64];
+    char* end;
+    int invalid = 0;
+
+    if(arg == NULL){
+        arg = "";
+    }
+
+    // integer conversions are printed with the long long length modifier
+    memcpy(format, spec, specLen);
+    if(strchr("diouxX", conversion) != NULL){
+        format[specLen++] = 'l';
+        format[specLen++] = 'l';
+    }
+    format[specLen++] = conversion;
+    format[specLen] = '\0';
+
+    errno = 0;
+    switch(conversion){
+        case 'd':
+        case 'i':
+            {
+                long long value = strtoll(arg, &end, 0);
+                invalid = *end != '\0' || errno != 0;
+                printf(format, value);
+            }
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            {
+                unsigned long long value = strtoull(arg, &end, 0);
+                invalid = *end != '\0' || errno != 0;
+                printf(format, value);
+            }
+            break;
+        case 'a':
+        case 'A':
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+            {
+                double value = strtod(arg, &end);
+                invalid = *end != '\0' || errno != 0;
+                printf(format, value);
+            }
+            break;
+        case 'c':
+            if(arg[0] != '\0'){
+                printf(format, arg[0]);
+            }
+            break;
+        default:
+            printf(format, arg);
+            break;
+    }
+    if(invalid){
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+    }
+    return invalid;
+}
+
+/*
+// Print format once, taking the arguments of its conversions from args.
+// Returns a pointer to the first argument that was not used, or NULL if the output was ended by \c or an error.
+*/
+static char** printFormat(char* format, char** args, int* failed){
+    char* str = format;
+
+    while(*str != '\0'){
+        if(*str == '\\'){
+            str = printEscape(str + 1, 0);
+            if(str == NULL){
+                return NULL;
+            }
+            continue;
+        }
+        if(*str != '%'){
+            putchar(*str);
+            str++;
+            continue;
+        }
+        if(str[1] == '%'){
+            putchar('%');
+            str += 2;
+            continue;
+        }
+
+        // %[flags][width][.precision]conversion
+        char* spec = str;
+        str++;
+        str += strspn(str, "-+ #0");
+        str += strspn(str, "0123456789");
+        if(*str == '.'){
+            str++;
+            str += strspn(str, "0123456789");
+        }
+        if(*str == '\0' || strchr("diouxXaAeEfFgGcsb", *str) == NULL || str - spec > 32){
+            fprintf(stderr, "printf: %.*s: invalid conversion\n", (int)(str - spec + (*str != '\0')), spec);
+            *failed = 1;
+            return NULL;
+        }
+
+        char* arg = *args;
+        if(arg != NULL){
+            args++;
+        }
+        if(*str == 'b'){
+            // %b prints its argument with the backslash escapes expanded
+            char* escaped = arg != NULL ? arg : "";
+            while(*escaped != '\0'){
+                if(*escaped == '\\'){
+                    escaped = printEscape(escaped + 1, 1);
+                    if(escaped == NULL){
+                        return NULL;
+                    }
+                } else {
+                    putchar(*escaped);
+                    escaped++;
+                }
+            }
+        } else if(printConversion(spec, str - spec, *str, arg)){
+            *failed = 1;
+        }
+        str++;
+    }
+    return args;
+}
+
+/*
+// Print the arguments under the control of a format, as printf(1) does.
+// The format is reused while there are arguments left.
+*/
+void smallsh_printf(struct command* smallsh_command){
+    char** args = smallsh_command->args;
+    char** next;
+    char** used;
+    int failed = 0;
+
+    if(args[1] == NULL){
+        fprintf(stderr, "usage: printf format [arguments...]\n");
+        fflush(stderr);
+        exitStatus = 1;
+        return;
+    }
+
+    next = args + 2;
+    do {
+        used = next;
+        next = printFormat(args[1], next, &failed);
+    } while(next != NULL && next[0] != NULL && next != used);
+    fflush(stdout);
+    fflush(stderr);
+    exitStatus = failed;
+}
+
+/*
+// Convert an operand of a numeric comparison. Returns 0, or 2 and prints an error if str is not an integer.
+*/
+static int testNumber(char* str, long long* value){
+    char* end;
+
+    errno = 0;
+    *value = strtoll(str, &end, 10);
+    if(str[0] == '\0' || *end != '\0' || errno != 0){
+        fprintf(stderr, "test: %s: integer expected\n", str);
+        return 2;
+    }
+    return 0;
+}
+
+/*
+// Evaluate a unary test such as -f file. Returns 0 if it is true, 1 if it is false and 2 on an error.
+*/
+static int testUnary(char* op, char* arg){
+    struct stat info;
+
+    if(op[0] != '-' || op[1] == '\0' || op[2] != '\0'){
+        fprintf(stderr, "test: %s: unary operator expected\n", op);
+        return 2;
+    }
+    switch(op[1]){
+        case 'n': return arg[0] == '\0';
+        case 'z': return arg[0] != '\0';
+        case 'e': return stat(arg, &info) != 0;
+        case 'f': return stat(arg, &info) != 0 || !S_ISREG(info.st_mode);
+        case 'd': return stat(arg, &info) != 0 || !S_ISDIR(info.st_mode);
+        case 'p': return stat(arg, &info) != 0 || !S_ISFIFO(info.st_mode);
+        case 's': return stat(arg, &info) != 0 || info.st_size == 0;
+        case 'h':
+        case 'L': return lstat(arg, &info) != 0 || !S_ISLNK(info.st_mode);
+        case 'r': return access(arg, R_OK) != 0;
+        case 'w': return access(arg, W_OK) != 0;
+        case 'x': return access(arg, X_OK) != 0;
+        case 't': return !isatty(atoi(arg));
+    }
+    fprintf(stderr, "test: %s: unary operator expected\n", op);
+    return 2;
+}
+
+/*
+// Evaluate a binary test such as a = b or 1 -lt 2.
+// Returns 0 if it is true, 1 if it is false, 2 on an error and -1 if op is not a binary operator.
+*/
+static int testBinary(char* left, char* op, char* right){
+    long long a;
+    long long b;
+
+    if(strcmp(op, "=") == 0 || strcmp(op, "==") == 0){
+        return strcmp(left, right) != 0;
+    }
+    if(strcmp(op, "!=") == 0){
+        return strcmp(left, right) == 0;
+    }
+    if(op[0] != '-' || strlen(op) != 3 || strstr("-eq-ne-lt-le-gt-ge", op) == NULL){
+        return -1;
+    }
+    if(testNumber(left, &a) || testNumber(right, &b)){
+        return 2;
+    }
+    switch(op[1] * 256 + op[2]){
+        case 'e' * 256 + 'q': return !(a == b);
+        case 'n' * 256 + 'e': return !(a != b);
+        case 'l' * 256 + 't': return !(a < b);
+        case 'l' * 256 + 'e': return !(a <= b);
+        case 'g' * 256 + 't': return !(a > b);
+        default: return !(a >= b);
+    }
+}
+
+/*
+// Evaluate the arguments of test, chosen by how many there are as POSIX describes.
+// Returns 0 if the expression is true, 1 if it is false and 2 on an error.
+*/
+static int testArgs(char** args, int argc){
+    int result;
+
+    switch(argc){
+        case 0:
+            return 1;
+        case 1:
+            return args[0][0] == '\0';
+        case 2:
+            if(strcmp(args[0], "!") == 0){
+                result = testArgs(args + 1, 1);
+                return result == 2 ? 2 : !result;
+            }
+            return testUnary(args[0], args[1]);
+        case 3:
+            result = testBinary(args[0], args[1], args[2]);
+            if(result != -1){
+                return result;
+            }
+            if(strcmp(args[0], "!") == 0){
+                result = testArgs(args + 1, 2);
+                return result == 2 ? 2 : !result;
+            }
+            fprintf(stderr, "test: %s: binary operator expected\n", args[1]);
+            return 2;
+        case 4:
+            if(strcmp(args[0], "!") == 0){
+                result = testArgs(args + 1, 3);
+                return result == 2 ? 2 : !result;
+            }
+            break;
+    }
+    fprintf(stderr, "test: too many arguments\n");
+    return 2;
+}
+
+/*
+// Evaluate a conditional expression, either "test expr" or "[ expr ]".
+// Sets exitStatus to 0 if the expression is true, 1 if it is false and 2 if it is not valid.
+*/
+void smallsh_test(struct command* smallsh_command){
+    int argc = smallsh_command->argc - 1;
+
+    if(strcmp(smallsh_command->args[0], "[") == 0){
+        if(argc == 0 || strcmp(smallsh_command->args[argc], "]") != 0){
+            fprintf(stderr, "[: missing ]\n");
+            fflush(stderr);
+            exitStatus = 2;
+            return;
+        }
+        argc--;
+    }
+    exitStatus = testArgs(smallsh_command->args + 1, argc);
+    fflush(stderr);
+}
+
+/*
+// Print the current working directory
+*/
+void smallsh_pwd(struct command* smallsh_command){
+    char* cwd = getcwd(NULL, 0);
+
+    if(cwd == NULL){
+        perror("pwd");
+        exitStatus = 1;
+        return;
+    }
+    printf("%s\n", cwd);
+    fflush(stdout);
+    free(cwd);
+    exitStatus = 0;
+}
+
+void smallsh_true(struct command* smallsh_command){
+    exitStatus = 0;
+}
+
+void smallsh_false(struct command* smallsh_command){
+    exitStatus = 1;
+}
+
+/*
+// Read one character for the read builtin, returning EOF at the end of the input.
+// When stdin is not the interactive input of smallsh it is read one byte at a time through the fd,
+// so nothing after the line is consumed and commands run later still see it.
+*/
+static int readChar(int unbuffered){
+    unsigned char c;
+    ssize_t numRead;
+
+    if(!unbuffered){
+        return readInputChar();
+    }
+    do {
+        numRead = read(STDIN_FILENO, &c, 1);
+    } while(numRead == -1 && errno == EINTR);
+    return numRead == 1 ? c : EOF;
+}
+
+/*
+// Read a line from stdin and split it into fields that are assigned to the named variables.
+// The last variable gets the rest of the line. Without names the whole line is assigned to REPLY.
+// Unless -r is given, a backslash removes the special meaning of the next character and a backslash before
+// the newline continues the line.
+// Sets exitStatus to 1 at the end of the input.
+*/
+void smallsh_read(struct command* smallsh_command){
+    char** names = smallsh_command->args + 1;
+    int raw = 0;
+    int unbuffered = batch != NULL || redirectsFd(smallsh_command, STDIN_FILENO);
+    size_t capacity = 128;
+    size_t len = 0;
+    char* line = arenaAlloc(commandArena, capacity);
+    int c;
+
+    if(names[0] != NULL && strcmp(names[0], "-r") == 0){
+        raw = 1;
+        names++;
+    }
+
+    fflush(stdout);
+    while((c = readChar(unbuffered)) != EOF && c != '\n'){
+        if(c == '\\' && !raw){
+            c = readChar(unbuffered);
+            if(c == '\n'){
+                continue;
+            }
+            if(c == EOF){
+                break;
+            }
+        }
+        if(len + 1 == capacity){
+            line = arenaGrow(commandArena, line, capacity, capacity * 2);
+            capacity *= 2;
+        }
+        line[len++] = c;
+    }
+    line[len] = '\0';
+    exitStatus = c == EOF ? 1 : 0;
+
+    if(names[0] == NULL){
+        setVariable(shellVariables, "REPLY", line, 0);
+        return;
+    }
+
+    // split on blanks, the last name takes whatever is left with the trailing blanks removed
+    char* field = line + strspn(line, " \t");
+    for(; names[0] != NULL; names++){
+        char* end;
+        if(names[1] == NULL){
+            end = field + strlen(field);
+            while(end > field && (end[-1] == ' ' || end[-1] == '\t')){
+                end--;
+            }
+            *end = '\0';
+            setVariable(shellVariables, names[0], field, 0);
+            break;
+        }
+        end = field + strcspn(field, " \t");
+        if(*end != '\0'){
+            *end = '\0';
+            end++;
+            end += strspn(end, " \t");
+        }
+        setVariable(shellVariables, names[0], field, 0);
+        field = end;
+    }
+}
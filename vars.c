@@ -0,0 +1,412 @@
+/***************************************
+ * Smallsh: shell variables
+ * Every variable is stored as the "NAME=value" string that is passed to commands when it is exported, so the
+ * environment of a command is an array of pointers into the table. That array is only rebuilt when a variable is
+ * exported, not for every command that is launched. A changed or removed variable is patched in place, so the array,
+ * which is also environ, never points to a freed string.
+***************************************/
+#include "smallsh.h"
+
+/*
+// FNV-1a hash of the len characters of a name
+*/
+static unsigned int hashName(const char* name, size_t len){
+    unsigned int hash = 2166136261u;
+    size_t i;
+
+    for(i = 0; i < len; i++){
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+// Return the length of the variable name at the start of text, 0 if text does not start with one
+*/
+size_t variableNameLen(const char* text){
+    size_t len = 0;
+
+    if(text[0] != '_' && !isalpha((unsigned char)text[0])){
+        return 0;
+    }
+    while(text[len] == '_' || isalnum((unsigned char)text[len])){
+        len++;
+    }
+    return len;
+}
+
+/*
+// Find the bucket holding the variable called by the len characters of name.
+// Returns the empty bucket where it would be inserted if it is not set.
+*/
+static int findVariable(struct variableTable* table, const char* name, size_t len){
+    int bucket = (int)(hashName(name, len) & (unsigned int)(table->capacity - 1));
+    struct variable* entry;
+
+    while(1){
+        entry = &table->entries[bucket];
+        if(entry->text == NULL || (entry->nameLen == len && memcmp(entry->text, name, len) == 0)){
+            return bucket;
+        }
+        bucket = (bucket + 1) & (table->capacity - 1);
+    }
+}
+
+/*
+// Allocate a table and fill it with the variables of environment, which are all exported
+*/
+struct variableTable* initVariables(char** environment){
+    struct variableTable* table = malloc(sizeof(struct variableTable));
+    size_t nameLen;
+
+    table->count = 0;
+    table->capacity = 64;
+    table->entries = calloc(table->capacity, sizeof(struct variable));
+    table->environment = NULL;
+    table->environmentCapacity = 0;
+    table->environmentStale = 1;
+    for(; environment != NULL && *environment != NULL; environment++){
+        nameLen = variableNameLen(*environment);
+        if(nameLen > 0 && (*environment)[nameLen] == '='){
+            assignVariable(table, *environment, VARIABLE_EXPORTED);
+        }
+    }
+    return table;
+}
+
+/*
+// Free all memory associated with a variable table
+*/
+void freeVariables(struct variableTable* table){
+    int i;
+
+    if(table == NULL){
+        return;
+    }
+    for(i = 0; i < table->capacity; i++){
+        free(table->entries[i].text);
+    }
+    if(environ == table->environment){
+        environ = NULL;
+    }
+    free(table->environment);
+    free(table->entries);
+    free(table);
+}
+
+/*
+// Return the value of the variable called name, or NULL if it is not set
+*/
+char* getVariable(struct variableTable* table, const char* name){
+    size_t len = strlen(name);
+    struct variable* entry = &table->entries[findVariable(table, name, len)];
+
+    return entry->text != NULL ? entry->text + len + 1 : NULL;
+}
+
+/*
+// Put a "NAME=value" string allocated with malloc() into the table, replacing the variable of the same name.
+// flags are added to those the variable already had. The table takes ownership of text.
+// A variable already in the environment array gets its new text there before the old one is freed.
+*/
+static void storeVariable(struct variableTable* table, char* text, size_t nameLen, int flags){
+    struct variable* oldEntries;
+    int oldCapacity;
+    int bucket = findVariable(table, text, nameLen);
+    int i;
+
+    if(table->entries[bucket].text == NULL){
+        // keep the table at most half full
+        if((table->count + 1) * 2 > table->capacity){
+            oldEntries = table->entries;
+            oldCapacity = table->capacity;
+            table->capacity *= 2;
+            table->entries = calloc(table->capacity, sizeof(struct variable));
+            for(i = 0; i < oldCapacity; i++){
+                if(oldEntries[i].text != NULL){
+                    table->entries[findVariable(table, oldEntries[i].text, oldEntries[i].nameLen)] = oldEntries[i];
+                }
+            }
+            free(oldEntries);
+            bucket = findVariable(table, text, nameLen);
+        }
+        table->count++;
+        table->entries[bucket].flags = 0;
+        table->entries[bucket].envIndex = -1;
+    }
+    if(table->entries[bucket].envIndex != -1){
+        table->environment[table->entries[bucket].envIndex] = text;
+    }
+    free(table->entries[bucket].text);
+    table->entries[bucket].text = text;
+    table->entries[bucket].nameLen = nameLen;
+    table->entries[bucket].flags |= flags;
+    if((table->entries[bucket].flags & VARIABLE_EXPORTED) && table->entries[bucket].envIndex == -1){
+        table->environmentStale = 1;
+    }
+}
+
+/*
+// Set the variable called name to value. flags are added to those the variable already had.
+*/
+void setVariable(struct variableTable* table, const char* name, const char* value, int flags){
+    size_t nameLen = strlen(name);
+    size_t valueLen = strlen(value);
+    char* text = malloc(nameLen + valueLen + 2);
+
+    memcpy(text, name, nameLen);
+    text[nameLen] = '=';
+    memcpy(text + nameLen + 1, value, valueLen + 1);
+    storeVariable(table, text, nameLen, flags);
+}
+
+/*
+// Set a variable from an assignment of the form NAME=value. flags are added to those the variable already had.
+// Returns -1 if assignment does not start with a valid name followed by '='.
+*/
+int assignVariable(struct variableTable* table, const char* assignment, int flags){
+    size_t nameLen = variableNameLen(assignment);
+
+    if(nameLen == 0 || assignment[nameLen] != '='){
+        return -1;
+    }
+    storeVariable(table, strdup(assignment), nameLen, flags);
+    return 0;
+}
+
+/*
+// Remove the entry in bucket from the table, without freeing its text.
+// Its text is taken out of the environment array, whose last variable moves into its place.
+*/
+static void removeVariableBucket(struct variableTable* table, int bucket){
+    int index = table->entries[bucket].envIndex;
+    char* moved;
+    int next;
+    int home;
+
+    if(index != -1){
+        table->environmentCount--;
+        moved = table->environment[table->environmentCount];
+        table->environment[index] = moved;
+        table->environment[table->environmentCount] = NULL;
+        table->entries[findVariable(table, moved, strcspn(moved, "="))].envIndex = index;
+        table->entries[bucket].envIndex = -1;
+    }
+    table->entries[bucket].text = NULL;
+    table->count--;
+
+    // Backward shift deletion, as in pidMapRemoveBucket()
+    next = (bucket + 1) & (table->capacity - 1);
+    while(table->entries[next].text != NULL){
+        home = (int)(hashName(table->entries[next].text, table->entries[next].nameLen) & (unsigned int)(table->capacity - 1));
+        if(((next - home) & (table->capacity - 1)) >= ((next - bucket) & (table->capacity - 1))){
+            table->entries[bucket] = table->entries[next];
+            table->entries[next].text = NULL;
+            bucket = next;
+        }
+        next = (next + 1) & (table->capacity - 1);
+    }
+}
+
+/*
+// Remove the variable called name, if it is set
+*/
+void unsetVariable(struct variableTable* table, const char* name){
+    int bucket = findVariable(table, name, strlen(name));
+    char* text = table->entries[bucket].text;
+
+    if(text != NULL){
+        removeVariableBucket(table, bucket);
+        free(text);
+    }
+}
+
+/*
+// Return the environment for commands, the "NAME=value" strings of every exported variable ending with NULL.
+// The array is rebuilt only if a variable was exported since the last call, and also becomes environ,
+// so getenv() and execvp() see the same variables as the commands smallsh launches.
+*/
+char** exportedEnvironment(struct variableTable* table){
+    int count = 0;
+    int i;
+
+    if(!table->environmentStale){
+        return table->environment;
+    }
+    if(table->environmentCapacity < table->count + 1){
+        table->environmentCapacity = (table->count + 1) * 2;
+        table->environment = realloc(table->environment, table->environmentCapacity * sizeof(char*));
+    }
+    for(i = 0; i < table->capacity; i++){
+        table->entries[i].envIndex = -1;
+        if(table->entries[i].text != NULL && (table->entries[i].flags & VARIABLE_EXPORTED)){
+            table->entries[i].envIndex = count;
+            table->environment[count] = table->entries[i].text;
+            count++;
+        }
+    }
+    table->environment[count] = NULL;
+    table->environmentCount = count;
+    table->environmentStale = 0;
+    environ = table->environment;
+    return table->environment;
+}
+
+/*
+// Return the environment for a command run with NAME=value assignments before its name, allocated from arena.
+// It is a copy of the exported environment in which the assignments replace the variables they set.
+*/
+char** commandEnvironment(struct variableTable* table, struct arena* arena, char** assignments, int count){
+    char** exported = exportedEnvironment(table);
+    char** environment = arenaAlloc(arena, (table->environmentCount + count + 1) * sizeof(char*));
+    int numVariables = table->environmentCount;
+    struct variable* entry;
+    size_t nameLen;
+    int i;
+    int j;
+
+    memcpy(environment, exported, numVariables * sizeof(char*));
+    for(i = 0; i < count; i++){
+        nameLen = variableNameLen(assignments[i]);
+        entry = &table->entries[findVariable(table, assignments[i], nameLen)];
+        if(entry->text != NULL && (entry->flags & VARIABLE_EXPORTED)){
+            environment[entry->envIndex] = assignments[i];
+            continue;
+        }
+
+        // a variable that is not exported is added, once even if it is assigned twice
+        for(j = table->environmentCount; j < numVariables && strncmp(environment[j], assignments[i], nameLen + 1) != 0; j++);
+        environment[j] = assignments[i];
+        if(j == numVariables){
+            numVariables++;
+        }
+    }
+    environment[numVariables] = NULL;
+    return environment;
+}
+
+/*
+// Set the variables of NAME=value assignments for a builtin or function, exported as they would be for a program.
+// Returns what they replaced, which restoreVariables() puts back afterwards. Allocated from arena.
+*/
+struct variable* saveVariables(struct variableTable* table, struct arena* arena, char** assignments, int count){
+    struct variable* saved = arenaAlloc(arena, count * sizeof(struct variable));
+    size_t nameLen;
+    int bucket;
+    int i;
+
+    for(i = 0; i < count; i++){
+        nameLen = variableNameLen(assignments[i]);
+        bucket = findVariable(table, assignments[i], nameLen);
+        saved[i] = table->entries[bucket];
+        if(saved[i].text != NULL){
+            // take the old text out of the table, so storeVariable() does not free it
+            removeVariableBucket(table, bucket);
+        }
+        storeVariable(table, strdup(assignments[i]), nameLen, VARIABLE_EXPORTED);
+    }
+    return saved;
+}
+
+/*
+// Undo saveVariables(), in reverse order so a variable assigned twice gets its first value back
+*/
+void restoreVariables(struct variableTable* table, char** assignments, struct variable* saved, int count){
+    char* text;
+    size_t nameLen;
+    int bucket;
+    int i;
+
+    for(i = count - 1; i >= 0; i--){
+        nameLen = variableNameLen(assignments[i]);
+        bucket = findVariable(table, assignments[i], nameLen);
+        if(table->entries[bucket].text != NULL){
+            text = table->entries[bucket].text;
+            removeVariableBucket(table, bucket);
+            free(text);
+        }
+        if(saved[i].text != NULL){
+            storeVariable(table, saved[i].text, saved[i].nameLen, saved[i].flags);
+        }
+    }
+}
+
+static int compareVariables(const void* a, const void* b){
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/*
+// The export builtin exports variables to the commands smallsh runs.
+// Usage: export NAME[=value]... sets and exports the variables, export alone lists the exported variables.
+*/
+void smallsh_export(struct command* smallsh_command){
+    char** args = smallsh_command->args;
+    char** environment;
+    char* text;
+    size_t nameLen;
+    int bucket;
+    int count;
+    int i;
+
+    exitStatus = 0;
+    if(args[1] == NULL){
+        // list them sorted, with values single quoted so they can be read back
+        environment = exportedEnvironment(shellVariables);
+        count = shellVariables->environmentCount;
+        environment = memcpy(arenaAlloc(commandArena, (count + 1) * sizeof(char*)), environment, (count + 1) * sizeof(char*));
+        qsort(environment, count, sizeof(char*), compareVariables);
+        for(i = 0; i < count; i++){
+            nameLen = strcspn(environment[i], "=");
+            printf("export %.*s='", (int)nameLen, environment[i]);
+            for(text = environment[i] + nameLen + 1; *text != '\0'; text++){
+                if(*text == '\''){
+                    fputs("'\\''", stdout);
+                } else {
+                    putchar(*text);
+                }
+            }
+            printf("'\n");
+        }
+        fflush(stdout);
+        return;
+    }
+
+    for(i = 1; args[i] != NULL; i++){
+        nameLen = variableNameLen(args[i]);
+        if(nameLen == 0 || (args[i][nameLen] != '=' && args[i][nameLen] != '\0')){
+            fprintf(stderr, "export: %s: not a valid identifier\n", args[i]);
+            fflush(stderr);
+            exitStatus = 1;
+        } else if(args[i][nameLen] == '='){
+            assignVariable(shellVariables, args[i], VARIABLE_EXPORTED);
+        } else {
+            // a name alone exports the variable if it is set
+            bucket = findVariable(shellVariables, args[i], nameLen);
+            if(shellVariables->entries[bucket].text != NULL && !(shellVariables->entries[bucket].flags & VARIABLE_EXPORTED)){
+                shellVariables->entries[bucket].flags |= VARIABLE_EXPORTED;
+                shellVariables->environmentStale = 1;
+            }
+        }
+    }
+}
+
+/*
+// The unset builtin removes variables.
+// Usage: unset NAME...
+*/
+void smallsh_unset(struct command* smallsh_command){
+    char** args = smallsh_command->args;
+    int i;
+
+    exitStatus = 0;
+    for(i = 1; args[i] != NULL; i++){
+        if(variableNameLen(args[i]) != strlen(args[i])){
+            fprintf(stderr, "unset: %s: not a valid identifier\n", args[i]);
+            fflush(stderr);
+            exitStatus = 1;
+            continue;
+        }
+        unsetVariable(shellVariables, args[i]);
+    }
+}